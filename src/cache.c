@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "cache.h"
+
+/* Cache of values with an expiration time, keyed by strings. The total size
+   of the values is bounded: when there is no room for a new value, the ones
+   with lowest priority are dropped. Expired values are dropped when they are
+   looked up.
+
+   Priorities follow the GreedyDual-Size policy: when a value is stored or
+   used, its priority is set to the cache "age" plus the cost of obtaining it
+   again divided by its size; the age is raised to the priority of each value
+   dropped. So values that are expensive to obtain and small are kept longer,
+   while values not used for a while end up dropped. When all costs are 0 it
+   is a plain LRU policy.
+
+   Each value can be accounted to an owner, to know how much memory it
+   uses.
+
+   Values can also be kept for a while after they expire, so users accepting
+   stale values can get them while they obtain a fresh one */
+
+typedef struct {
+  gchar *key;
+  gpointer value;
+  gsize size;
+  gdouble cost;
+  gdouble priority;
+  guint64 stamp;
+  gint64 expires;
+  gint64 stale_expires;
+  gconstpointer owner;
+  GSequenceIter *iter;
+} CacheEntry;
+
+struct _Cache {
+  gsize max_size;
+  gsize size;
+  gdouble age;
+  guint64 stamp;
+  GHashTable *entries;
+  GSequence *queue;
+  GHashTable *owners;
+  GDestroyNotify value_destroy_func;
+};
+
+static gint
+cache_entry_compare (CacheEntry *a,
+                     CacheEntry *b,
+                     gpointer user_data)
+{
+  if (a->priority != b->priority) {
+    return a->priority < b->priority? -1: 1;
+  }
+
+  /* Least recently used first */
+  return a->stamp < b->stamp? -1: (a->stamp > b->stamp? 1: 0);
+}
+
+static void
+cache_entry_free (Cache *cache,
+                  CacheEntry *entry)
+{
+  g_free (entry->key);
+  if (cache->value_destroy_func) {
+    cache->value_destroy_func (entry->value);
+  }
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+cache_entry_touch (Cache *cache,
+                   CacheEntry *entry)
+{
+  entry->priority = cache->age + (entry->size? entry->cost / entry->size: 0);
+  entry->stamp = cache->stamp++;
+}
+
+static void
+cache_owner_add (Cache *cache,
+                 gconstpointer owner,
+                 gssize size)
+{
+  gsize owner_size;
+
+  if (!owner) {
+    return;
+  }
+
+  owner_size = GPOINTER_TO_SIZE (g_hash_table_lookup (cache->owners, owner)) + size;
+  if (owner_size) {
+    g_hash_table_insert (cache->owners, (gpointer) owner, GSIZE_TO_POINTER (owner_size));
+  } else {
+    g_hash_table_remove (cache->owners, owner);
+  }
+}
+
+static void
+cache_remove_entry (Cache *cache,
+                    CacheEntry *entry)
+{
+  g_hash_table_remove (cache->entries, entry->key);
+  g_sequence_remove (entry->iter);
+  cache->size -= entry->size;
+  cache_owner_add (cache, entry->owner, -(gssize) entry->size);
+  cache_entry_free (cache, entry);
+}
+
+/* Drops the values with lowest priority until there are @size bytes free */
+static void
+cache_make_room (Cache *cache,
+                 gsize size)
+{
+  CacheEntry *entry;
+
+  while (cache->size + size > cache->max_size) {
+    entry = g_sequence_get (g_sequence_get_begin_iter (cache->queue));
+    cache->age = entry->priority;
+    cache_remove_entry (cache, entry);
+  }
+}
+
+Cache *
+cache_new (gsize max_size,
+           GDestroyNotify value_destroy_func)
+{
+  Cache *cache;
+
+  cache = g_slice_new0 (Cache);
+  cache->max_size = max_size;
+  cache->entries = g_hash_table_new (g_str_hash, g_str_equal);
+  cache->queue = g_sequence_new (NULL);
+  cache->owners = g_hash_table_new (NULL, NULL);
+  cache->value_destroy_func = value_destroy_func;
+
+  return cache;
+}
+
+void
+cache_free (Cache *cache)
+{
+  GSequenceIter *iter;
+
+  if (!cache) {
+    return;
+  }
+
+  g_hash_table_unref (cache->entries);
+  g_hash_table_unref (cache->owners);
+  for (iter = g_sequence_get_begin_iter (cache->queue);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter)) {
+    cache_entry_free (cache, g_sequence_get (iter));
+  }
+  g_sequence_free (cache->queue);
+
+  g_slice_free (Cache, cache);
+}
+
+/* Returns the value stored for key, or NULL if there is none or it has
+   expired. If stale is not NULL, values that have expired but are still kept
+   are returned too, setting stale to TRUE */
+gpointer
+cache_lookup_stale (Cache *cache,
+                    const gchar *key,
+                    gboolean *stale)
+{
+  CacheEntry *entry;
+  gint64 now;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (!entry) {
+    return NULL;
+  }
+
+  now = g_get_monotonic_time ();
+  if (stale) {
+    *stale = entry->expires <= now;
+  }
+
+  if (entry->expires <= now &&
+      (!stale || entry->stale_expires <= now)) {
+    cache_remove_entry (cache, entry);
+    return NULL;
+  }
+
+  cache_entry_touch (cache, entry);
+  g_sequence_sort_changed (entry->iter,
+                           (GCompareDataFunc) cache_entry_compare,
+                           NULL);
+
+  return entry->value;
+}
+
+/* Stores value for ttl seconds, taking ownership of it. size is the amount of
+   memory the value uses, and cost (any unit, the same for all the values)
+   what it takes to obtain it again. The value is kept stale seconds more once
+   expired, and its size is accounted to owner */
+void
+cache_insert_full (Cache *cache,
+                   const gchar *key,
+                   gpointer value,
+                   gsize size,
+                   gdouble cost,
+                   guint ttl,
+                   guint stale,
+                   gconstpointer owner)
+{
+  CacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry) {
+    cache_remove_entry (cache, entry);
+  }
+
+  /* Does not fit at all */
+  if (ttl == 0 || size > cache->max_size) {
+    if (cache->value_destroy_func) {
+      cache->value_destroy_func (value);
+    }
+    return;
+  }
+
+  cache_make_room (cache, size);
+
+  entry = g_slice_new (CacheEntry);
+  entry->key = g_strdup (key);
+  entry->value = value;
+  entry->size = size;
+  entry->cost = cost;
+  entry->expires = g_get_monotonic_time () + (gint64) ttl * G_USEC_PER_SEC;
+  entry->stale_expires = entry->expires + (gint64) stale * G_USEC_PER_SEC;
+  entry->owner = owner;
+  cache_entry_touch (cache, entry);
+  entry->iter = g_sequence_insert_sorted (cache->queue,
+                                          entry,
+                                          (GCompareDataFunc) cache_entry_compare,
+                                          NULL);
+
+  g_hash_table_insert (cache->entries, entry->key, entry);
+  cache->size += size;
+  cache_owner_add (cache, owner, size);
+}
+
+/* Removes all the values accounted to owner */
+void
+cache_remove_owner (Cache *cache,
+                    gconstpointer owner)
+{
+  CacheEntry *entry;
+  GSequenceIter *iter;
+
+  iter = g_sequence_get_begin_iter (cache->queue);
+  while (!g_sequence_iter_is_end (iter) &&
+         g_hash_table_lookup (cache->owners, owner)) {
+    entry = g_sequence_get (iter);
+    iter = g_sequence_iter_next (iter);
+    if (entry->owner == owner) {
+      cache_remove_entry (cache, entry);
+    }
+  }
+}
+
+/* Returns the amount of memory used by the values accounted to owner */
+gsize
+cache_get_owner_size (Cache *cache,
+                      gconstpointer owner)
+{
+  return GPOINTER_TO_SIZE (g_hash_table_lookup (cache->owners, owner));
+}
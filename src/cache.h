@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <glib.h>
+
+typedef struct _Cache Cache;
+
+Cache *cache_new (gsize max_size,
+                  GDestroyNotify value_destroy_func);
+
+void cache_free (Cache *cache);
+
+gpointer cache_lookup_stale (Cache *cache,
+                             const gchar *key,
+                             gboolean *stale);
+
+void cache_insert_full (Cache *cache,
+                        const gchar *key,
+                        gpointer value,
+                        gsize size,
+                        gdouble cost,
+                        guint ttl,
+                        guint stale,
+                        gconstpointer owner);
+
+void cache_remove_owner (Cache *cache,
+                         gconstpointer owner);
+
+gsize cache_get_owner_size (Cache *cache,
+                            gconstpointer owner);
+
+#endif /* _CACHE_H_ */
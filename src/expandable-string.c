@@ -22,592 +22,632 @@
 
 #include "expandable-string.h"
 
-#include "json-ghashtable.h"
+#include "html-entities.h"
+#include "private-keys.h"
 
-#include <libxml/HTMLparser.h>
+#include <stdlib.h>
 #include <string.h>
 
 typedef enum {
-  UNKNOWN,
   EXPANDABLE,
   UNEXPANDABLE,
 } ExpandableStatus;
 
+typedef enum {
+  SEGMENT_LITERAL,
+  SEGMENT_KEY,
+  SEGMENT_PARAM,
+  SEGMENT_BUFFER,
+  SEGMENT_PRIVATE,
+} SegmentType;
+
+typedef enum {
+  PARAM_SEARCH_TEXT,
+  PARAM_SKIP,
+  PARAM_COUNT,
+  PARAM_PAGE_NUMBER,
+  PARAM_PAGE_SIZE,
+  PARAM_PAGE_OFFSET,
+  PARAM_INVALID,
+} ParamType;
+
+typedef void (*KeyFormatFunc) (GrlData *data,
+                               GrlKeyID key,
+                               GString *result);
+
+typedef struct {
+  SegmentType type;
+  ParamType param;
+  GrlKeyID key;
+  KeyFormatFunc key_format;
+  gchar *text;
+  gsize text_len;
+} Segment;
+
 struct _ExpandableString {
   gchar *str;
   ExpandableStatus status;
+  ExpandDependencies dependencies;
+  Segment *segments;
+  guint n_segments;
+  gsize literal_len;
+  gchar *no_data_value;
 };
 
 struct _ExpandData {
   guint refcount;
   gchar *source_id;
   GrlMedia *media;
+  gboolean private_keys_loaded;
   GHashTable *private_keys;
-  gchar *search_text;
-  GrlOperationOptions *options;
-  guint max_page_size;
+  gchar *params[PARAM_INVALID];
   GHashTable *regexp_buffers;
+  GHashTable *values;
 };
 
-static GRegex *
-expand_pattern_factory (void)
+/* Computes once all the parameters values for the operation */
+static void
+expand_data_init_params (ExpandData *data,
+                         const gchar *search_text,
+                         GrlOperationOptions *options,
+                         guint max_page_size)
 {
-  static GRegex *pattern = NULL;
-
-  if (!pattern) {
-    pattern = g_regex_new ("%.*%", G_REGEX_OPTIMIZE | G_REGEX_UNGREEDY, 0, NULL);
-  }
-
-  return pattern;
-}
+  gint count;
+  guint page_number = 0;
+  guint page_offset = 0;
+  guint page_size = 0;
+  guint skip;
 
-static GRegex *
-expand_pattern_entity (void)
-{
-  static GRegex *pattern = NULL;
+  skip = grl_operation_options_get_skip (options);
+  count = grl_operation_options_get_count (options);
 
-  if (!pattern) {
-    pattern = g_regex_new ("&.+;", G_REGEX_OPTIMIZE | G_REGEX_UNGREEDY, 0, NULL);
-  }
+  grl_paging_translate (skip,
+                        count,
+                        max_page_size,
+                        &page_size,
+                        &page_number,
+                        &page_offset);
 
-  return pattern;
+  data->params[PARAM_SEARCH_TEXT] = g_strdup (search_text);
+  data->params[PARAM_SKIP] = g_strdup_printf ("%d", skip);
+  data->params[PARAM_COUNT] = g_strdup_printf ("%d", count);
+  data->params[PARAM_PAGE_NUMBER] = g_strdup_printf ("%d", page_number);
+  data->params[PARAM_PAGE_SIZE] = g_strdup_printf ("%d", page_size);
+  data->params[PARAM_PAGE_OFFSET] = g_strdup_printf ("%d", page_offset);
 }
 
-inline static gchar *
-expand_data_get_search_text (ExpandData *data)
-{
-  if (!data) {
-    return NULL;
-  }
+static const struct {
+  const gchar *prefix;
+  gsize prefix_len;
+  SegmentType type;
+} placeholder_types[] = {
+  { "key:", 4, SEGMENT_KEY },
+  { "param:", 6, SEGMENT_PARAM },
+  { "buf:", 4, SEGMENT_BUFFER },
+  { "priv:", 5, SEGMENT_PRIVATE },
+};
 
-  return g_strdup (data->search_text);
-}
+static const gchar *param_names[] = {
+  "search_text",
+  "skip",
+  "count",
+  "page_number",
+  "page_size",
+  "page_offset",
+};
 
-inline static gchar *
-expand_data_get_skip (ExpandData *data)
+/* Searches the next '%...%' placeholder in str. As with the former '%.*%'
+   regular expression, the closing '%' is the first one found, and a
+   placeholder never spans over several lines */
+static const gchar *
+placeholder_next (const gchar *str,
+                  const gchar **end)
 {
-  if (!data) {
-    return NULL;
+  const gchar *start;
+  const gchar *stop;
+
+  start = strchr (str, '%');
+  while (start) {
+    stop = strpbrk (start + 1, "%\n");
+    if (!stop) {
+      return NULL;
+    }
+    if (*stop == '%') {
+      *end = stop;
+      return start;
+    }
+    start = strchr (stop, '%');
   }
 
-  return g_strdup_printf ("%d", grl_operation_options_get_skip (data->options));
+  return NULL;
 }
 
-inline static gchar *
-expand_data_get_count (ExpandData *data)
+static SegmentType
+placeholder_get_type (const gchar *start,
+                      const gchar *end,
+                      const gchar **name)
 {
-  if (!data) {
-    return NULL;
+  gsize token_len;
+  guint i;
+
+  /* Skip the leading '%' */
+  start++;
+  token_len = end - start;
+
+  for (i = 0; i < G_N_ELEMENTS (placeholder_types); i++) {
+    if (token_len >= placeholder_types[i].prefix_len &&
+        strncmp (start,
+                 placeholder_types[i].prefix,
+                 placeholder_types[i].prefix_len) == 0) {
+      *name = start + placeholder_types[i].prefix_len;
+      return placeholder_types[i].type;
+    }
   }
 
-  return g_strdup_printf ("%d", grl_operation_options_get_count (data->options));
+  return SEGMENT_LITERAL;
 }
 
-static gchar *
-expand_data_get_page_number (ExpandData *data)
+static ParamType
+param_get_type (const gchar *param_name)
 {
-  guint page_number = 0;
+  guint i;
 
-  if (!data) {
-    return NULL;
+  for (i = 0; i < G_N_ELEMENTS (param_names); i++) {
+    if (g_strcmp0 (param_names[i], param_name) == 0) {
+      return (ParamType) i;
+    }
   }
 
-  grl_paging_translate (grl_operation_options_get_skip (data->options),
-                        grl_operation_options_get_count (data->options),
-                        data->max_page_size,
-                        NULL,
-                        &page_number,
-                        NULL);
-
-  return g_strdup_printf ("%d", page_number);
+  return PARAM_INVALID;
 }
 
+/* Expands the values that are known when loading the spec: configuration
+   (%conf:...%) and located strings (%str:...%) */
 static gchar *
-expand_data_get_page_size (ExpandData *data)
+expand_static_values (const gchar *init,
+                      GrlConfig *config,
+                      GList *located_strings)
 {
-  guint page_size = 0;
-
-  if (!data) {
-    return NULL;
+  GList *l;
+  GString *result;
+  const gchar *end;
+  const gchar *start;
+  const gchar *str;
+  const gchar *str_value;
+  gchar *match;
+  gchar *value;
+
+  result = g_string_sized_new (strlen (init));
+  str = init;
+
+  while ((start = placeholder_next (str, &end)) != NULL) {
+    g_string_append_len (result, str, start - str);
+    str = end + 1;
+
+    match = g_strndup (start + 1, end - start - 1);
+    if (g_str_has_prefix (match, "conf:")) {
+      value = grl_config_get_string (config, match + 5);
+      if (value) {
+        g_string_append (result, value);
+        g_free (value);
+      } else {
+        GRL_DEBUG ("No value found for %s", match);
+      }
+    } else if (g_str_has_prefix (match, "str:")) {
+      /* Search the located string */
+      str_value = NULL;
+      l = located_strings;
+      while (l && !str_value) {
+        str_value = g_hash_table_lookup (l->data, match + 4);
+        l = g_list_next (l);
+      }
+      if (str_value) {
+        g_string_append (result, str_value);
+      } else {
+        GRL_DEBUG ("No value found for %s", match);
+      }
+    } else {
+      /* Leave it as it is */
+      g_string_append_len (result, start, end - start + 1);
+    }
+    g_free (match);
   }
 
-  grl_paging_translate (grl_operation_options_get_skip (data->options),
-                        grl_operation_options_get_count (data->options),
-                        data->max_page_size,
-                        &page_size,
-                        NULL,
-                        NULL);
+  g_string_append (result, str);
 
-  return g_strdup_printf ("%d", page_size);
+  return g_string_free (result, FALSE);
 }
 
-static gchar *
-expand_data_get_page_offset (ExpandData *data)
+static void
+key_format_string (GrlData *data,
+                   GrlKeyID key,
+                   GString *result)
 {
-  guint page_offset = 0;
+  const gchar *value;
 
-  if (!data) {
-    return NULL;
+  value = grl_data_get_string (data, key);
+  if (value) {
+    g_string_append (result, value);
   }
+}
 
-  grl_paging_translate (grl_operation_options_get_skip (data->options),
-                        grl_operation_options_get_count (data->options),
-                        data->max_page_size,
-                        NULL,
-                        NULL,
-                        &page_offset);
-
-  return g_strdup_printf ("%d", page_offset);
+static void
+key_format_int (GrlData *data,
+                GrlKeyID key,
+                GString *result)
+{
+  g_string_append_printf (result, "%d", grl_data_get_int (data, key));
 }
 
-static gboolean
-expand_remaining_cb (const GMatchInfo *match_info,
-                     GString *result,
-                     gpointer data)
+static void
+key_format_float (GrlData *data,
+                  GrlKeyID key,
+                  GString *result)
 {
-  gchar *match;
+  g_string_append_printf (result, "%f", grl_data_get_float (data, key));
+}
 
-  match = g_match_info_fetch (match_info, 0);
+static void
+key_format_date_time (GrlData *data,
+                      GrlKeyID key,
+                      GString *result)
+{
+  gchar *value;
 
-  /* Special case: '%%' is expanded by single '%' */
-  if (strlen (match) == 2) {
-    g_string_append (result, "%");
-    g_free (match);
-    return TRUE;
+  value = g_date_time_format ((GDateTime *) grl_data_get_boxed (data, key),
+                              "%FT%T");
+  if (value) {
+    g_string_append (result, value);
+    g_free (value);
   }
-  g_free (match);
-
-  return FALSE;
 }
 
+/* Binds the metadata key and the function to convert its value to string */
 static gboolean
-expand_metadata_key_cb (const GMatchInfo *match_info,
-                        GString *result,
-                        ExpandData *expand_data)
+segment_bind_key (Segment *segment)
 {
   GType key_type;
-  GrlKeyID key;
   GrlRegistry *registry;
-  const gchar *key_name = NULL;
-  gchar **match_tokens;
-  gchar *key_value = NULL;
-  gchar *match;
-  gint match_len;
 
-  match = g_match_info_fetch (match_info, 0);
-  match_len = strlen (match);
-
-  /* Remove the leading and trailing '%' character */
-  match[match_len - 1] = '\0';
-  match++;
-
-  /* Check if we need to expand by metadata key value */
-  match_tokens = g_strsplit (match, ":", 2);
-  if (g_strv_length (match_tokens) == 2 &&
-      g_strcmp0 (match_tokens[0], "key") == 0) {
-    key_name = match_tokens[1];
-  } else {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return FALSE;
-  }
-
-  /* Search for the key */
   registry = grl_registry_get_default ();
-  key = grl_registry_lookup_metadata_key (registry, key_name);
-  if (key == GRL_METADATA_KEY_INVALID) {
-    GRL_WARNING ("Invalid key '%s'", key_name);
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return TRUE;
-  }
-
-  /* If it has not got a value, use an empty value */
-  if (!expand_data ||
-      !expand_data->media ||
-      !grl_data_has_key (GRL_DATA (expand_data->media), key)) {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return TRUE;
+  segment->key = grl_registry_lookup_metadata_key (registry, segment->text);
+  if (segment->key == GRL_METADATA_KEY_INVALID) {
+    GRL_WARNING ("Invalid key '%s'", segment->text);
+    return FALSE;
   }
 
-  /* Convert type to string */
-  key_type = grl_metadata_key_get_type (key);
-
+  key_type = grl_metadata_key_get_type (segment->key);
   if (key_type == G_TYPE_STRING) {
-    key_value = g_strdup (grl_data_get_string (GRL_DATA (expand_data->media), key));
+    segment->key_format = key_format_string;
   } else if (key_type == G_TYPE_INT) {
-    key_value = g_strdup_printf ("%d", grl_data_get_int (GRL_DATA (expand_data->media), key));
+    segment->key_format = key_format_int;
   } else if (key_type == G_TYPE_FLOAT) {
-    key_value = g_strdup_printf ("%f", grl_data_get_float (GRL_DATA (expand_data->media), key));
+    segment->key_format = key_format_float;
   } else if (key_type == G_TYPE_DATE_TIME) {
-    key_value = g_date_time_format (grl_data_get_boxed (GRL_DATA (expand_data->media), key),
-                                    "%FT%T");
+    segment->key_format = key_format_date_time;
+  } else {
+    GRL_WARNING ("Key '%s' can not be converted to string", segment->text);
+    return FALSE;
   }
 
-  g_string_append (result, key_value);
+  return TRUE;
+}
+
+static void
+segments_add_literal (GArray *segments,
+                      GString *literal)
+{
+  Segment segment = { 0 };
 
-  g_free (key_value);
-  g_free (--match);
-  g_strfreev (match_tokens);
+  if (literal->len == 0) {
+    return;
+  }
 
-  return TRUE;
+  segment.type = SEGMENT_LITERAL;
+  segment.text = g_strndup (literal->str, literal->len);
+  segment.text_len = literal->len;
+  g_array_append_val (segments, segment);
+  g_string_truncate (literal, 0);
 }
 
-static gboolean
-expand_private_cb (const GMatchInfo *match_info,
-                   GString *result,
-                   ExpandData *expand_data)
+/* Splits the string in a sequence of literal and placeholder segments, so
+   expanding it later is just a walk through the segments */
+static void
+expandable_string_compile (ExpandableString *exp_str)
 {
-  gchar **match_tokens;
-  gchar *match;
-  gchar *priv_name;
-  gchar *priv_value;
-  gint match_len;
+  GArray *segments;
+  ExpandDependencies dependencies = 0;
+  GString *literal;
+  Segment segment;
+  const gchar *end;
+  const gchar *name;
+  const gchar *start;
+  const gchar *str;
+  gsize literal_len = 0;
+
+  segments = g_array_new (FALSE, FALSE, sizeof (Segment));
+  literal = g_string_sized_new (strlen (exp_str->str));
+  str = exp_str->str;
+
+  while ((start = placeholder_next (str, &end)) != NULL) {
+    g_string_append_len (literal, str, start - str);
+    str = end + 1;
+
+    /* Special case: '%%' is expanded by single '%' */
+    if (end == start + 1) {
+      g_string_append_c (literal, '%');
+      continue;
+    }
 
-  match = g_match_info_fetch (match_info, 0);
-  match_len = strlen (match);
+    segment.type = placeholder_get_type (start, end, &name);
+    if (segment.type == SEGMENT_LITERAL) {
+      /* Unknown placeholder; leave it as it is */
+      g_string_append_len (literal, start, end - start + 1);
+      continue;
+    }
 
-  /* Remove the leading and trailing '%' character */
-  match[match_len - 1] = '\0';
-  match++;
+    segment.text_len = end - name;
+    segment.text = g_strndup (name, segment.text_len);
+    segment.param = PARAM_INVALID;
+    segment.key = GRL_METADATA_KEY_INVALID;
+    segment.key_format = NULL;
 
-  /* Check if we need to expand by private value */
-  match_tokens = g_strsplit (match, ":", 2);
-  if (g_strv_length (match_tokens) == 2 &&
-      g_strcmp0 (match_tokens[0], "priv") == 0) {
-    priv_name = match_tokens[1];
-  } else {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return FALSE;
-  }
+    if (segment.type == SEGMENT_KEY && !segment_bind_key (&segment)) {
+      /* Expanded always as an empty value */
+      g_free (segment.text);
+      continue;
+    }
 
-  /* Search the private value */
-  if (!expand_data ||
-      !expand_data->private_keys) {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return TRUE;
+    switch (segment.type) {
+    case SEGMENT_KEY:
+      dependencies |= EXPAND_DEPENDS_ON_MEDIA;
+      break;
+    case SEGMENT_PARAM:
+      segment.param = param_get_type (segment.text);
+      dependencies |= EXPAND_DEPENDS_ON_PARAMS;
+      break;
+    case SEGMENT_BUFFER:
+      dependencies |= EXPAND_DEPENDS_ON_BUFFERS;
+      break;
+    case SEGMENT_PRIVATE:
+      dependencies |= EXPAND_DEPENDS_ON_PRIVATE;
+      break;
+    default:
+      break;
+    }
+
+    literal_len += literal->len;
+    segments_add_literal (segments, literal);
+    g_array_append_val (segments, segment);
   }
 
-  /* Prepend source_id to the private name */
-  priv_name = g_strconcat (expand_data->source_id, "::", priv_name, NULL);
-  priv_value = g_hash_table_lookup (expand_data->private_keys, priv_name);
-  g_free (priv_name);
-  if (priv_value) {
-    g_string_append (result, priv_value);
+  g_string_append (literal, str);
+
+  if (segments->len == 0) {
+    /* Nothing to expand at all */
+    g_free (exp_str->str);
+    exp_str->str = g_string_free (literal, FALSE);
+    exp_str->status = UNEXPANDABLE;
+    exp_str->segments = NULL;
+    exp_str->n_segments = 0;
+    exp_str->literal_len = 0;
+    g_array_free (segments, TRUE);
+    return;
   }
 
-  g_free (--match);
-  g_strfreev (match_tokens);
+  literal_len += literal->len;
+  segments_add_literal (segments, literal);
+  g_string_free (literal, TRUE);
 
-  return TRUE;
+  exp_str->status = EXPANDABLE;
+  exp_str->dependencies = dependencies;
+  exp_str->literal_len = literal_len;
+  exp_str->n_segments = segments->len;
+  exp_str->segments = (Segment *) g_array_free (segments, FALSE);
 }
 
-static gboolean
-expand_config_cb (const GMatchInfo *match_info,
-                  GString *result,
-                  GrlConfig *config)
+static void
+expand_metadata_key (Segment *segment,
+                     GString *result,
+                     ExpandData *expand_data)
 {
-  gchar **match_tokens;
-  gchar *key_value = NULL;
-  gchar *match;
-  gint match_len;
-
-  match = g_match_info_fetch (match_info, 0);
-  /* Remove the leading and trailing '%' character */
-  match_len = strlen (match);
-  match[match_len - 1] = '\0';
-  match++;
-
-  /* Check if we need to expand by config value or leave as it is */
-  match_tokens = g_strsplit (match, ":", 2);
-  if (g_strv_length (match_tokens) == 2 &&
-      g_strcmp0 (match_tokens[0], "conf") == 0) {
-    key_value = grl_config_get_string (config, match_tokens[1]);
-    if (key_value) {
-      g_string_append (result, key_value);
-      g_free (key_value);
-    } else {
-      GRL_DEBUG ("No value found for %s", match);
-    }
-    match--;
-  } else {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return FALSE;
+  /* If it has not got a value, use an empty value */
+  if (!expand_data ||
+      !expand_data->media ||
+      !grl_data_has_key (GRL_DATA (expand_data->media), segment->key)) {
+    return;
   }
 
-  g_strfreev (match_tokens);
-  g_free (match);
-
-  return TRUE;
+  segment->key_format (GRL_DATA (expand_data->media), segment->key, result);
 }
 
-static gboolean
-expand_str_cb (const GMatchInfo *match_info,
-               GString *result,
-               GList *located_strings)
+static void
+expand_private (Segment *segment,
+                GString *result,
+                ExpandData *expand_data)
 {
-  GList *l;
-  const gchar *str = NULL;
-  gchar **match_tokens;
-  gchar *match;
-  gint match_len;
-
-  match = g_match_info_fetch (match_info, 0);
-  /* Remove the leading and trailing '%' character */
-  match_len = strlen (match);
-  match[match_len - 1] = '\0';
-  match++;
-
-  /* Check if we need to expand by str value or leave as it is */
-  match_tokens = g_strsplit (match, ":", 2);
-  if (g_strv_length (match_tokens) == 2 &&
-      g_strcmp0 (match_tokens[0], "str") == 0) {
-    /* Search the located string */
-    l = located_strings;
-    while (l && !str) {
-      str = g_hash_table_lookup (l->data, match_tokens[1]);
-      l = g_list_next (l);
-    }
-    if (str) {
-      g_string_append (result, str);
-    } else {
-      GRL_DEBUG ("No value found for %s", match);
+  gchar *priv_name;
+  gchar *priv_value;
+
+  if (!expand_data) {
+    return;
+  }
+
+  /* Private keys are only decoded when they are needed */
+  if (!expand_data->private_keys_loaded) {
+    expand_data->private_keys = private_keys_get (expand_data->media);
+    if (expand_data->private_keys) {
+      g_hash_table_ref (expand_data->private_keys);
     }
-    match--;
-  } else {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return FALSE;
+    expand_data->private_keys_loaded = TRUE;
   }
 
-  g_strfreev (match_tokens);
-  g_free (match);
+  /* Search the private value */
+  if (!expand_data->private_keys) {
+    return;
+  }
 
-  return TRUE;
+  /* Prepend source_id to the private name */
+  priv_name = g_strconcat (expand_data->source_id, "::", segment->text, NULL);
+  priv_value = g_hash_table_lookup (expand_data->private_keys, priv_name);
+  g_free (priv_name);
+  if (priv_value) {
+    g_string_append (result, priv_value);
+  }
 }
 
-static gboolean
-expand_param_cb (const GMatchInfo *match_info,
-                 GString *result,
-                 ExpandData *data)
+static void
+expand_param (Segment *segment,
+              GString *result,
+              ExpandData *data)
 {
-  gchar **match_tokens;
-  gchar *match;
-  gchar *param_name = NULL;
-  gchar *param_value = NULL;
-  gint match_len;
-
-  match = g_match_info_fetch (match_info, 0);
-  /* Remove the leading and trailing '%' character */
-  match_len = strlen (match);
-  match[match_len -1] = '\0';
-  match++;
-
-  /* Check if we need to expand by config value or leave as it is */
-  match_tokens = g_strsplit (match, ":", 2);
-  if (g_strv_length (match_tokens) == 2 &&
-      g_strcmp0 (match_tokens[0], "param") == 0) {
-    param_name = match_tokens[1];
-  } else {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return FALSE;
-  }
+  const gchar *param_value;
 
-  if (param_name) {
-    if (g_strcmp0 (param_name, "search_text") == 0) {
-      param_value = expand_data_get_search_text (data);
-    } else if (g_strcmp0 (param_name, "skip") == 0) {
-      param_value = expand_data_get_skip (data);
-    } else if (g_strcmp0 (param_name, "count") == 0) {
-      param_value = expand_data_get_count (data);
-    } else if (g_strcmp0 (param_name, "page_number") == 0) {
-      param_value = expand_data_get_page_number (data);
-    } else if (g_strcmp0 (param_name, "page_size") == 0) {
-      param_value = expand_data_get_page_size (data);
-    } else if (g_strcmp0 (param_name, "page_offset") == 0) {
-      param_value = expand_data_get_page_offset (data);
-    } else {
-      GRL_WARNING ("Invalid parameter '%s'", param_name);
-    }
-    match--;
+  if (segment->param == PARAM_INVALID) {
+    GRL_WARNING ("Invalid parameter '%s'", segment->text);
+    return;
   }
 
-  g_strfreev (match_tokens);
-  g_free (match);
+  if (!data) {
+    return;
+  }
 
+  param_value = data->params[segment->param];
   if (param_value) {
     g_string_append (result, param_value);
-    g_free (param_value);
   }
-
-  return TRUE;
 }
 
-static gboolean
-expand_buffer_id_cb (const GMatchInfo *match_info,
-                     GString *result,
-                     ExpandData *data)
+static void
+expand_buffer_id (Segment *segment,
+                  GString *result,
+                  ExpandData *data)
 {
   const gchar *buffer_content;
-  gchar **match_tokens;
-  gchar *buffer_id;
-  gchar *match;
-  gint match_len;
-
-  match = g_match_info_fetch (match_info, 0);
-  /* Remove the leading and trailing '%' character */
-  match_len = strlen (match);
-  match[match_len -1] = '\0';
-  match++;
-
-  /* Check if we need to expand by buffer id or leave as it is */
-  match_tokens = g_strsplit (match, ":", 2);
-  if (g_strv_length (match_tokens) == 2 &&
-      g_strcmp0 (match_tokens[0], "buf") == 0) {
-    buffer_id = match_tokens[1];
-  } else {
-    g_free (--match);
-    g_strfreev (match_tokens);
-    return FALSE;
-  }
 
   if (data && data->regexp_buffers) {
-    buffer_content = g_hash_table_lookup (data->regexp_buffers, buffer_id);
+    buffer_content = g_hash_table_lookup (data->regexp_buffers, segment->text);
     if (buffer_content) {
       g_string_append (result, buffer_content);
     }
   }
-
-  g_free (--match);
-  g_strfreev (match_tokens);
-
-  return TRUE;
 }
 
-static gboolean
-expand_html_entity_cb (const GMatchInfo *match_info,
-                       GString *result,
-                       gpointer data)
-{
-  const htmlEntityDesc *entity;
-  gchar *match;
-  gint match_len;
-
-  match = g_match_info_fetch (match_info, 0);
-  /* Remove the leading '&' and trailing ';' characteres */
-  match_len = strlen (match);
-  match[match_len - 1] = '\0';
-  match++;
-
-  entity = htmlEntityLookup ((const xmlChar *) match);
-  if (entity) {
-    g_string_insert_unichar (result, -1, entity->value);
-    match--;
-  } else {
-    /* Restore characteres and put as it is */
-    match--;
-    match[match_len - 1] = ';';
-    g_string_append (result, match);
-  }
+#define HTML_ENTITY_MAX_NAME 32
 
-  g_free (match);
+/* Highest Unicode code point */
+#define HTML_ENTITY_MAX_VALUE 0x10FFFF
 
-  return TRUE;
+static int
+html_entity_compare (const void *name,
+                     const void *entity)
+{
+  return strcmp ((const gchar *) name, ((const HtmlEntity *) entity)->name);
 }
 
-static gchar *
-expand_full (const gchar *string,
-             GRegex *pattern,
-             GRegexEvalCallback eval,
-             gpointer user_data,
-             ...)
+/* Decodes the entity starting at str (just after the '&'). Returns the
+   number of bytes used, including the ';', or 0 if it is not a valid
+   entity */
+static gsize
+html_entity_decode (const gchar *str,
+                    const gchar *end,
+                    gunichar *value)
 {
-  GMatchInfo *match_info = NULL;
-  GRegexEvalCallback feval;
-  GString *result;
-  gint end_pos = 0;
-  gint start_pos = 0;
-  gint str_pos = 0;
-  gint string_length;
-  gpointer fdata;
-  va_list vlist;
-
-  string_length = strlen (string);
-  result = g_string_sized_new (string_length);
-  g_regex_match_full (pattern, string, string_length, 0, 0, &match_info, NULL);
-  while (g_match_info_matches (match_info)) {
-    g_match_info_fetch_pos (match_info, 0, &start_pos, &end_pos);
-    g_string_append_len (result, string + str_pos, start_pos - str_pos);
-    str_pos = end_pos;
-    feval = eval;
-    fdata = user_data;
-    va_start (vlist, user_data);
-    while (feval) {
-      if ((*feval) (match_info, result, fdata)) {
-        break;
-      }
-      feval = va_arg (vlist, GRegexEvalCallback);
-      if (feval) {
-        fdata = va_arg (vlist, gpointer);
+  const gchar *p;
+  const HtmlEntity *entity;
+  gchar name[HTML_ENTITY_MAX_NAME + 1];
+  guint base = 10;
+  guint64 number = 0;
+  gsize name_len;
+
+  if (str < end && *str == '#') {
+    /* Numeric character reference */
+    p = str + 1;
+    if (p < end && (*p == 'x' || *p == 'X')) {
+      base = 16;
+      p++;
+    }
+    /* Leading zeros are allowed; once the value is beyond any code point
+       the rest of the digits are skipped */
+    while (p < end &&
+           (base == 16? g_ascii_isxdigit (*p): g_ascii_isdigit (*p))) {
+      if (number <= HTML_ENTITY_MAX_VALUE) {
+        number = number * base + g_ascii_xdigit_value (*p);
       }
+      p++;
     }
-
-    va_end (vlist);
-    if (feval == NULL) {
-      /* String was not expanded; put it back */
-      g_string_append_len (result, string + start_pos, end_pos - start_pos);
+    if (p == end || *p != ';' ||
+        number == 0 ||
+        number > HTML_ENTITY_MAX_VALUE ||
+        !g_unichar_validate ((gunichar) number)) {
+      return 0;
     }
-    g_match_info_next (match_info, NULL);
+    *value = (gunichar) number;
+    return p - str + 1;
   }
 
-  g_match_info_free (match_info);
+  /* Named entity */
+  for (p = str; p < end && g_ascii_isalnum (*p); p++);
+  name_len = p - str;
+  if (p == end || *p != ';' || name_len == 0 || name_len > HTML_ENTITY_MAX_NAME) {
+    return 0;
+  }
 
-  /* Add remaing string */
-  g_string_append_len (result, string + str_pos, string_length - str_pos);
+  memcpy (name, str, name_len);
+  name[name_len] = '\0';
 
-  return g_string_free (result, FALSE);
-}
+  entity = bsearch (name,
+                    html_entities,
+                    G_N_ELEMENTS (html_entities),
+                    sizeof (HtmlEntity),
+                    html_entity_compare);
+  if (!entity) {
+    return 0;
+  }
+  *value = entity->value;
 
-static gchar *
-expand_string (const gchar *str,
-               ExpandData *expand_data)
-{
-  gchar *expanded_str;
-
-  expanded_str = expand_full (str,
-                              expand_pattern_factory(),
-                              (GRegexEvalCallback) expand_metadata_key_cb,
-                              expand_data,
-                              (GRegexEvalCallback) expand_param_cb,
-                              expand_data,
-                              (GRegexEvalCallback) expand_buffer_id_cb,
-                              expand_data,
-                              (GRegexEvalCallback) expand_private_cb,
-                              expand_data,
-                              (GRegexEvalCallback) expand_remaining_cb,
-                              NULL,
-                              NULL);
-
-  if (!expanded_str) {
-    GRL_DEBUG ("Some values cannot be expanded in '%s'", str);
-  }
-
-  return expanded_str;
+  return name_len + 1;
 }
 
+/* Decoding an entity never makes the string longer, so the result is written
+   in a buffer of the same size as the input, in a single pass */
 gchar *
 expand_html_entities (const gchar *str)
 {
-  return expand_full (str,
-                      expand_pattern_entity (),
-                      (GRegexEvalCallback) expand_html_entity_cb,
-                      NULL,
-                      NULL);
+  const gchar *amp;
+  const gchar *end;
+  const gchar *p;
+  gchar *out;
+  gchar *result;
+  gsize entity_len;
+  gsize len;
+  gunichar value;
+
+  len = strlen (str);
+  end = str + len;
+  result = g_malloc (len + 1);
+  out = result;
+  p = str;
+
+  while ((amp = memchr (p, '&', end - p)) != NULL) {
+    memcpy (out, p, amp - p);
+    out += amp - p;
+    entity_len = html_entity_decode (amp + 1, end, &value);
+    if (entity_len > 0) {
+      out += g_unichar_to_utf8 (value, out);
+      p = amp + 1 + entity_len;
+    } else {
+      /* Not an entity; put it as it is */
+      *(out++) = '&';
+      p = amp + 1;
+    }
+  }
+
+  memcpy (out, p, end - p);
+  out += end - p;
+  *out = '\0';
+
+  return result;
 }
 
 ExpandData *
@@ -618,14 +658,6 @@ expand_data_new (GrlXmlFactorySource *source,
 {
   ExpandData *p;
   guint autosplit;
-  static GrlKeyID GRL_METADATA_KEY_PRIVATE_KEYS = 0;
-  GrlRegistry *registry;
-
-  if (!GRL_METADATA_KEY_PRIVATE_KEYS) {
-    registry = grl_registry_get_default ();
-    GRL_METADATA_KEY_PRIVATE_KEYS = grl_registry_lookup_metadata_key (registry,
-                                                                      "xml-factory-private-keys");
-  }
 
   autosplit = grl_source_get_auto_split_threshold (GRL_SOURCE (source));
 
@@ -634,18 +666,17 @@ expand_data_new (GrlXmlFactorySource *source,
   g_object_get (G_OBJECT (source), "source-id", &(p->source_id), NULL);
   if (media) {
     p->media = g_object_ref (media);
-    p->private_keys = json_ghashtable_deserialize_data (grl_data_get_string (GRL_DATA (media),
-                                                                             GRL_METADATA_KEY_PRIVATE_KEYS),
-                                                        -1,
-                                                        NULL);
   } else {
     p->media = NULL;
-    p->private_keys = NULL;
   }
-  p->search_text = g_strdup (search_text);
-  p->options = g_object_ref (options);
-  p->max_page_size = (autosplit <= 0)? G_MAXINT: autosplit;
+  p->private_keys_loaded = FALSE;
+  p->private_keys = NULL;
+  expand_data_init_params (p,
+                           search_text,
+                           options,
+                           (autosplit <= 0)? G_MAXINT: autosplit);
   p->regexp_buffers = NULL;
+  p->values = NULL;
 
   return p;
 }
@@ -660,6 +691,8 @@ expand_data_ref (ExpandData *data)
 void
 expand_data_unref (ExpandData *data)
 {
+  gint i;
+
   data->refcount--;
 
   if (data->refcount > 0) {
@@ -673,11 +706,15 @@ expand_data_unref (ExpandData *data)
   if (data->private_keys) {
     g_hash_table_unref (data->private_keys);
   }
-  g_object_unref (data->options);
-  g_free (data->search_text);
+  for (i = 0; i < PARAM_INVALID; i++) {
+    g_free (data->params[i]);
+  }
   if (data->regexp_buffers) {
     g_hash_table_unref (data->regexp_buffers);
   }
+  if (data->values) {
+    g_hash_table_unref (data->values);
+  }
 
   g_slice_free (ExpandData, data);
 }
@@ -716,22 +753,11 @@ expandable_string_new (const gchar *init,
 {
   ExpandableString *exp_str;
 
-  exp_str = g_slice_new (ExpandableString);
+  exp_str = g_slice_new0 (ExpandableString);
 
   if (init) {
-    exp_str->str = expand_full (init,
-                                expand_pattern_factory (),
-                                (GRegexEvalCallback) expand_config_cb,
-                                config,
-                                (GRegexEvalCallback) expand_str_cb,
-                                located_strings,
-                                NULL);
-  } else {
-    exp_str->str = NULL;
-  }
-
-  if (exp_str->str) {
-    exp_str->status = UNKNOWN;
+    exp_str->str = expand_static_values (init, config, located_strings);
+    expandable_string_compile (exp_str);
   } else {
     exp_str->status = UNEXPANDABLE;
   }
@@ -742,40 +768,112 @@ expandable_string_new (const gchar *init,
 void
 expandable_string_free (ExpandableString *exp_str)
 {
+  guint i;
+
   if (exp_str) {
     g_free (exp_str->str);
+    for (i = 0; i < exp_str->n_segments; i++) {
+      g_free (exp_str->segments[i].text);
+    }
+    g_free (exp_str->segments);
+    g_free (exp_str->no_data_value);
     g_slice_free (ExpandableString, exp_str);
   }
 }
 
+/* Strings that only depend on the operation parameters get always the same
+   value for the same ExpandData, so they are expanded only once */
+static gboolean
+expandable_string_is_invariant (ExpandableString *exp_str)
+{
+  return exp_str->status == EXPANDABLE &&
+    exp_str->dependencies == EXPAND_DEPENDS_ON_PARAMS;
+}
+
+static gchar *
+expandable_string_expand (ExpandableString *exp_str,
+                          ExpandData *data)
+{
+  GString *result;
+  Segment *segment;
+  guint i;
+
+  result = g_string_sized_new (exp_str->literal_len + 16 * exp_str->n_segments);
+
+  for (i = 0; i < exp_str->n_segments; i++) {
+    segment = &exp_str->segments[i];
+    switch (segment->type) {
+    case SEGMENT_LITERAL:
+      g_string_append_len (result, segment->text, segment->text_len);
+      break;
+    case SEGMENT_KEY:
+      expand_metadata_key (segment, result, data);
+      break;
+    case SEGMENT_PARAM:
+      expand_param (segment, result, data);
+      break;
+    case SEGMENT_BUFFER:
+      expand_buffer_id (segment, result, data);
+      break;
+    case SEGMENT_PRIVATE:
+      expand_private (segment, result, data);
+      break;
+    }
+  }
+
+  return g_string_free (result, FALSE);
+}
+
+ExpandDependencies
+expandable_string_get_dependencies (ExpandableString *exp_str)
+{
+  return exp_str->dependencies;
+}
+
 gchar *
 expandable_string_get_value (ExpandableString *exp_str,
                              ExpandData *data)
 {
-  gchar *expanded_string;
+  gchar *value;
 
   if (exp_str->status == UNEXPANDABLE) {
     return exp_str->str;
   }
 
-  expanded_string = expand_string (exp_str->str, data);
+  if (!expandable_string_is_invariant (exp_str)) {
+    return expandable_string_expand (exp_str, data);
+  }
 
-  if (exp_str->status == UNKNOWN) {
-    if (g_strcmp0 (exp_str->str, expanded_string) == 0) {
-      exp_str->status = UNEXPANDABLE;
-    } else {
-      exp_str->status = EXPANDABLE;
+  if (!data) {
+    if (!exp_str->no_data_value) {
+      exp_str->no_data_value = expandable_string_expand (exp_str, NULL);
     }
+    return exp_str->no_data_value;
+  }
+
+  if (!data->values) {
+    data->values = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          g_free);
+  }
+
+  value = g_hash_table_lookup (data->values, exp_str);
+  if (!value) {
+    value = expandable_string_expand (exp_str, data);
+    g_hash_table_insert (data->values, exp_str, value);
   }
 
-  return expanded_string;
+  return value;
 }
 
 void
 expandable_string_free_value (ExpandableString *exp_str,
                               gchar *value)
 {
-  if (exp_str->str != value) {
+  /* Values of invariant strings are owned by the ExpandData */
+  if (exp_str->str != value &&
+      !expandable_string_is_invariant (exp_str)) {
     g_free (value);
   }
 }
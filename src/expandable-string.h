@@ -29,6 +29,13 @@ typedef struct _ExpandableString ExpandableString;
 
 typedef struct _ExpandData ExpandData;
 
+typedef enum {
+  EXPAND_DEPENDS_ON_MEDIA   = 1 << 0,
+  EXPAND_DEPENDS_ON_PARAMS  = 1 << 1,
+  EXPAND_DEPENDS_ON_BUFFERS = 1 << 2,
+  EXPAND_DEPENDS_ON_PRIVATE = 1 << 3,
+} ExpandDependencies;
+
 
 ExpandData *expand_data_new (GrlXmlFactorySource *source,
                              GrlMedia *media,
@@ -52,6 +59,8 @@ ExpandableString *expandable_string_new (const gchar *init,
 
 void expandable_string_free (ExpandableString *exp_str);
 
+ExpandDependencies expandable_string_get_dependencies (ExpandableString *exp_str);
+
 gchar *expandable_string_get_value (ExpandableString *exp_str,
                                     ExpandData *data);
 
@@ -20,6 +20,7 @@
  *
  */
 
+#include "cache.h"
 #include "fetch.h"
 #include "grl-xml-factory.h"
 
@@ -27,6 +28,10 @@
 #include <rest/rest-proxy.h>
 #include <string.h>
 
+/* Seconds an expired response with validators is kept, so it can be
+   revalidated instead of fetched again */
+#define REVALIDATE_TIME (24 * 60 * 60)
+
 typedef struct _NetProcessData {
   FetchData *fetch_data;
   GrlXmlFactorySource *source;
@@ -36,8 +41,23 @@ typedef struct _NetProcessData {
   GCancellable *cancellable;
   DataFetchedCb callback;
   gpointer user_data;
+  gulong cancelled_id;
 } NetProcessData;
 
+/* Request being fetched. All the NetProcessData asking for the same request
+   while it is in flight wait for it, and get the same response */
+typedef struct _RequestData {
+  guint refcount;
+  GrlXmlFactorySource *source;
+  gchar *key;
+  GCancellable *cancellable;
+  RestProxyCall *call;
+  GList *waiters;
+  DataRef *revalidated;
+  gchar *etag;
+  gchar *last_modified;
+} RequestData;
+
 typedef struct  _ExpressionProcessData {
   NetProcessData *net_data;
   GetRawCb get_raw_callback;
@@ -87,12 +107,324 @@ net_process_data_free (NetProcessData *data)
     expand_data_unref (data->expand_data);
   }
   if (data->cancellable) {
+    if (data->cancelled_id) {
+      g_cancellable_disconnect (data->cancellable, data->cancelled_id);
+    }
     g_object_unref (data->cancellable);
   }
 
   g_slice_free (NetProcessData, data);
 }
 
+typedef struct {
+  gchar *content;
+  gsize size;
+  GError *error;
+  gchar *etag;
+  gchar *last_modified;
+} CachedResponse;
+
+static CachedResponse *
+cached_response_new (const gchar *content,
+                     gsize size,
+                     const GError *error)
+{
+  CachedResponse *response;
+
+  response = g_slice_new0 (CachedResponse);
+  if (error) {
+    response->error = g_error_copy (error);
+  } else {
+    response->content = g_strndup (content, size);
+    response->size = size;
+  }
+
+  return response;
+}
+
+static void
+cached_response_free (CachedResponse *response)
+{
+  g_free (response->content);
+  g_free (response->etag);
+  g_free (response->last_modified);
+  if (response->error) {
+    g_error_free (response->error);
+  }
+  g_slice_free (CachedResponse, response);
+}
+
+/* If there is a cached response for @key, sends it and returns %TRUE. Failed
+   requests are cached too, and their error is sent again.
+
+   If @revalidate is not %NULL and the response has expired but can be
+   revalidated, it is stored there and %FALSE is returned */
+static gboolean
+fetch_cache_lookup (GrlXmlFactorySource *source,
+                    GrlXmlDebug debug_flag,
+                    const gchar *key,
+                    DataRef **revalidate,
+                    DataFetchedCb callback,
+                    gpointer user_data)
+{
+  CachedResponse *response;
+  DataRef *cached;
+  gboolean stale = FALSE;
+
+  cached = cache_lookup_stale (grl_xml_factory_source_get_response_cache (source),
+                               key,
+                               revalidate? &stale: NULL);
+  if (!cached) {
+    return FALSE;
+  }
+
+  if (stale) {
+    response = dataref_value (cached);
+    if (!response->error && (response->etag || response->last_modified)) {
+      *revalidate = dataref_ref (cached);
+    }
+    return FALSE;
+  }
+
+  /* Callback could replace the cached response */
+  cached = dataref_ref (cached);
+  response = dataref_value (cached);
+  if (response->error) {
+    GRL_XML_DEBUG (source, debug_flag, "Reusing cached failure for '%s'", key);
+    callback (NULL, user_data, response->error);
+  } else {
+    GRL_XML_DEBUG (source, debug_flag, "Reusing cached response for '%s'", key);
+    callback (response->content, user_data, NULL);
+  }
+  dataref_unref (cached);
+
+  return TRUE;
+}
+
+/* Stores the response to @request. Failures and empty responses are stored
+   for @negative_cache_time seconds, so a broken service is not hammered.
+   Responses with validators are kept once expired to be revalidated */
+static void
+fetch_cache_store (RequestData *request,
+                   const gchar *content,
+                   gsize size,
+                   const GError *error,
+                   guint cache_time,
+                   guint negative_cache_time)
+{
+  CachedResponse *response;
+  guint stale = 0;
+  guint ttl;
+
+  if (error || !content || size == 0) {
+    ttl = negative_cache_time;
+  } else {
+    ttl = cache_time;
+  }
+
+  if (ttl == 0) {
+    return;
+  }
+
+  response = cached_response_new (content? content: "",
+                                  content? size: 0,
+                                  error);
+  if (!error) {
+    response->etag = g_strdup (request->etag);
+    response->last_modified = g_strdup (request->last_modified);
+    if (response->etag || response->last_modified) {
+      stale = REVALIDATE_TIME;
+    }
+  }
+
+  cache_insert_full (grl_xml_factory_source_get_response_cache (request->source),
+                     request->key,
+                     dataref_new (response, (GDestroyNotify) cached_response_free),
+                     strlen (request->key) + size + 2,
+                     0,
+                     ttl,
+                     stale,
+                     NULL);
+}
+
+static RequestData *
+request_data_ref (RequestData *request)
+{
+  request->refcount++;
+  return request;
+}
+
+static void
+request_data_unref (RequestData *request)
+{
+  request->refcount--;
+  if (request->refcount == 0) {
+    g_object_unref (request->source);
+    g_object_unref (request->cancellable);
+    g_clear_object (&request->call);
+    g_free (request->key);
+    g_clear_pointer (&request->revalidated, (GDestroyNotify) dataref_unref);
+    g_free (request->etag);
+    g_free (request->last_modified);
+    g_slice_free (RequestData, request);
+  }
+}
+
+/* Removes @request from the requests in flight, so new waiters do not attach
+   to it anymore */
+static void
+request_forget (RequestData *request)
+{
+  GHashTable *requests;
+
+  requests = grl_xml_factory_source_get_requests (request->source);
+  if (g_hash_table_lookup (requests, request->key) == request) {
+    g_hash_table_remove (requests, request->key);
+  }
+}
+
+static void
+request_send_cancelled (NetProcessData *data)
+{
+  GError *error;
+
+  error = g_error_new (GRL_CORE_ERROR,
+                       GRL_CORE_ERROR_OPERATION_CANCELLED,
+                       "Operation has been cancelled");
+  data->callback (NULL, data->user_data, error);
+  g_error_free (error);
+}
+
+/* Sends an error to the cancelled waiters; if there are no waiters left, the
+   request itself is cancelled */
+static gboolean
+request_check_cancelled (RequestData *request)
+{
+  GList *cancelled = NULL;
+  GList *waiter;
+  GList *next;
+  NetProcessData *data;
+  RestProxyCall *call;
+
+  for (waiter = request->waiters; waiter; waiter = next) {
+    next = g_list_next (waiter);
+    data = (NetProcessData *) waiter->data;
+    if (g_cancellable_is_cancelled (data->cancellable)) {
+      request->waiters = g_list_remove_link (request->waiters, waiter);
+      cancelled = g_list_concat (waiter, cancelled);
+    }
+  }
+
+  if (cancelled && !request->waiters) {
+    request_forget (request);
+    g_cancellable_cancel (request->cancellable);
+    /* RESTful calls do not use the cancellable. Cancelling can finish the
+       call at once, which releases it from the request */
+    if (request->call) {
+      call = g_object_ref (request->call);
+      rest_proxy_call_cancel (call);
+      g_object_unref (call);
+    }
+  }
+
+  for (waiter = cancelled; waiter; waiter = g_list_next (waiter)) {
+    data = (NetProcessData *) waiter->data;
+    request_send_cancelled (data);
+    net_process_data_free (data);
+  }
+  g_list_free (cancelled);
+
+  request_data_unref (request);
+
+  return FALSE;
+}
+
+static void
+request_waiter_cancelled (GCancellable *cancellable,
+                          RequestData *request)
+{
+  /* Handler can not be disconnected from here */
+  g_idle_add ((GSourceFunc) request_check_cancelled,
+              request_data_ref (request));
+}
+
+/* Adds @data as a waiter of the request identified by @key. Returns the
+   request if it is a new one and must be started by the caller, or NULL if
+   there is already one in flight */
+static RequestData *
+request_attach (const gchar *key,
+                NetProcessData *data)
+{
+  GHashTable *requests;
+  RequestData *request;
+  gboolean new_request = FALSE;
+
+  requests = grl_xml_factory_source_get_requests (data->source);
+  request = g_hash_table_lookup (requests, key);
+  if (!request) {
+    /* This reference is released when request finishes */
+    request = g_slice_new0 (RequestData);
+    request->refcount = 1;
+    request->source = g_object_ref (data->source);
+    request->key = g_strdup (key);
+    request->cancellable = g_cancellable_new ();
+    g_hash_table_insert (requests, g_strdup (key), request);
+    new_request = TRUE;
+  }
+
+  request->waiters = g_list_prepend (request->waiters, data);
+  data->cancelled_id = g_cancellable_connect (data->cancellable,
+                                              G_CALLBACK (request_waiter_cancelled),
+                                              request,
+                                              NULL);
+
+  return new_request? request: NULL;
+}
+
+/* Sends the response to all the waiters of @request */
+static void
+request_done (RequestData *request,
+              const gchar *content,
+              gsize size,
+              const GError *error)
+{
+  GList *waiter;
+  GList *waiters;
+  NetProcessData *data;
+  guint cache_time = 0;
+  guint negative_cache_time = 0;
+
+  request_forget (request);
+  waiters = g_list_reverse (request->waiters);
+  request->waiters = NULL;
+
+  /* A cancelled request did not fail, so it is not worth remembering */
+  if (!g_cancellable_is_cancelled (request->cancellable)) {
+    for (waiter = waiters; waiter; waiter = g_list_next (waiter)) {
+      data = (NetProcessData *) waiter->data;
+      cache_time = MAX (cache_time, data->fetch_data->cache_time);
+      negative_cache_time = MAX (negative_cache_time,
+                                 data->fetch_data->negative_cache_time);
+    }
+    fetch_cache_store (request, content, size, error,
+                       cache_time, negative_cache_time);
+  }
+
+  for (waiter = waiters; waiter; waiter = g_list_next (waiter)) {
+    data = (NetProcessData *) waiter->data;
+    GRL_XML_DUMP (data->fetch_data->dump, content, size);
+    if (g_cancellable_is_cancelled (data->cancellable)) {
+      request_send_cancelled (data);
+    } else {
+      data->callback (content, data->user_data, error);
+    }
+    net_process_data_free (data);
+  }
+  g_list_free (waiters);
+
+  request_data_unref (request);
+}
+
 static void
 expression_process_data_free (ExpressionProcessData *data) {
   net_process_data_free (data->net_data);
@@ -136,13 +468,46 @@ regexp_process_data_free (RegexpProcessData *data)
   g_slice_free (RegexpProcessData, data);
 }
 
+static GRegex *
+default_expression_regex (void)
+{
+  static GRegex *regex = NULL;
+
+  if (!regex) {
+    regex = g_regex_new ("(?ms)(.*)", G_REGEX_OPTIMIZE, 0, NULL);
+  }
+
+  return regex;
+}
+
+/* Returns the regex for the expression: either the one compiled when loading
+   the spec, or the one for the expanded expression */
+static GRegex *
+fetch_expression_get_regex (GrlXmlFactorySource *source,
+                            ExpandableString *expression,
+                            GRegex *compiled,
+                            ExpandData *expand_data)
+{
+  GRegex *regex;
+  gchar *expanded_expression;
+
+  if (compiled) {
+    return g_regex_ref (compiled);
+  }
+
+  expanded_expression = expandable_string_get_value (expression, expand_data);
+  regex = grl_xml_factory_source_get_regex (source, expanded_expression);
+  expandable_string_free_value (expression, expanded_expression);
+
+  return regex;
+}
+
 static void
 fetch_replace_input_obtained (const gchar *input,
                               ReplaceProcessData *data,
                               const GError *error)
 {
   GRegex *regex;
-  gchar *expanded_expression;
   gchar *expanded_replacement;
   gchar *output;
 
@@ -158,16 +523,15 @@ fetch_replace_input_obtained (const gchar *input,
     return;
   }
 
-  expanded_expression = expandable_string_get_value (data->replace->expression,
-                                                     data->common.net_data->expand_data);
-
-  if ((regex = g_regex_new (expanded_expression, 0, 0, NULL)) == NULL) {
+  regex = fetch_expression_get_regex (data->common.net_data->source,
+                                      data->replace->expression,
+                                      data->replace->regex,
+                                      data->common.net_data->expand_data);
+  if (!regex) {
     data->common.net_data->callback (NULL, data->common.net_data->user_data, NULL);
-    expandable_string_free_value (data->replace->expression, expanded_expression);
     replace_process_data_free (data);
     return;
   }
-  expandable_string_free_value (data->replace->expression, expanded_expression);
 
   if (data->replace->replacement) {
     expanded_replacement = expandable_string_get_value (data->replace->replacement,
@@ -205,7 +569,6 @@ fetch_regexp_input_obtained (const gchar *input,
   gboolean is_valid;
   gboolean repeat;
   gchar *decoded_input;
-  gchar *expanded_expression;
   gchar *expanded_output;
   gchar *expanded_references;
 
@@ -226,20 +589,22 @@ fetch_regexp_input_obtained (const gchar *input,
     g_string_append (result, expanded_output);
   } else {
     if (data->data->data.regexp->expression->expression) {
-      expanded_expression = expandable_string_get_value (data->data->data.regexp->expression->expression,
-                                                         data->common.net_data->expand_data);
-
-      if ((regex = g_regex_new (expanded_expression, 0, 0, NULL)) == NULL) {
+      regex = fetch_expression_get_regex (data->common.net_data->source,
+                                          data->data->data.regexp->expression->expression,
+                                          data->data->data.regexp->expression->regex,
+                                          data->common.net_data->expand_data);
+      if (!regex) {
         data->common.net_data->callback (NULL, data->common.net_data->user_data, NULL);
-        expandable_string_free_value (data->data->data.regexp->expression->expression, expanded_expression);
+        if (data->data->data.regexp->output) {
+          expandable_string_free_value (data->data->data.regexp->output, expanded_output);
+        }
+        g_string_free (result, TRUE);
         regexp_process_data_free (data);
         return;
       }
-      expandable_string_free_value (data->data->data.regexp->expression->expression, expanded_expression);
       repeat = data->data->data.regexp->expression->repeat;
     } else {
-      expanded_expression = "(?ms)(.*)";
-      regex = g_regex_new (expanded_expression, 0, 0, NULL);
+      regex = g_regex_ref (default_expression_regex ());
       repeat = FALSE;
     }
 
@@ -306,72 +671,114 @@ fetch_regexp_subregexp_obtained (const gchar *subregexp,
 static void
 fetch_data_url_content_obtained (GrlNetWc *wc,
                                  GAsyncResult *res,
-                                 NetProcessData *data)
+                                 RequestData *request)
 {
   GError *error = NULL;
   GError *net_error = NULL;
   gchar *content = NULL;
-  gsize size;
+  gsize size = 0;
 
-  if (g_cancellable_is_cancelled (data->cancellable)) {
-      error = g_error_new (GRL_CORE_ERROR,
-                           GRL_CORE_ERROR_OPERATION_CANCELLED,
-                           "Operation has been cancelled");
-  }
-
-  if (!error &&
-      !grl_net_wc_request_finish (wc, res, &content, &size, &net_error)) {
+  if (!grl_net_wc_request_finish (wc, res, &content, &size, &net_error)) {
     error = g_error_new (GRL_CORE_ERROR,
                          0,
                          "Unable to read source: %s", net_error->message);
     g_error_free (net_error);
   }
 
-  GRL_XML_DUMP (data->fetch_data->dump, content, size);
-
-  data->callback (content, data->user_data, error);
+  request_done (request, content, size, error);
   if (error) {
     g_error_free (error);
   }
-
-  net_process_data_free (data);
 }
 
 static void
 fetch_rest_fetched (RestProxyCall *call,
                     const GError *rest_error,
                     GObject *weak_object,
-                    NetProcessData *data)
+                    RequestData *request)
 {
-  GError *error = NULL;
+  CachedResponse *response;
   const gchar *content = NULL;
+  gsize size = 0;
 
-  if (rest_error) {
-    data->callback (NULL, data->user_data, rest_error);
-    g_slice_free (NetProcessData, data);
-    return;
+  /* The call is kept alive until the callback returns */
+  g_clear_object (&request->call);
+
+  if (!rest_error) {
+    content = rest_proxy_call_get_payload (call);
+    size = (gsize) rest_proxy_call_get_payload_length (call);
+  } else if (request->revalidated &&
+             g_error_matches (rest_error,
+                              REST_PROXY_ERROR,
+                              REST_PROXY_ERROR_HTTP_NOT_MODIFIED)) {
+    /* Cached response is still valid */
+    response = dataref_value (request->revalidated);
+    content = response->content;
+    size = response->size;
+    request->etag = g_strdup (response->etag);
+    request->last_modified = g_strdup (response->last_modified);
+    rest_error = NULL;
   }
 
-  if (g_cancellable_is_cancelled (data->cancellable)) {
-    error = g_error_new (GRL_CORE_ERROR,
-                         GRL_CORE_ERROR_OPERATION_CANCELLED,
-                         "Operation has been cancelled");
+  if (!rest_error) {
+    if (rest_proxy_call_lookup_response_header (call, "ETag")) {
+      g_free (request->etag);
+      request->etag = g_strdup (rest_proxy_call_lookup_response_header (call, "ETag"));
+    }
+    if (rest_proxy_call_lookup_response_header (call, "Last-Modified")) {
+      g_free (request->last_modified);
+      request->last_modified = g_strdup (rest_proxy_call_lookup_response_header (call, "Last-Modified"));
+    }
   }
 
-  if (!error) {
-    content = rest_proxy_call_get_payload (call);
+  request_done (request, content, size, rest_error);
+}
+
+/* Returns a new reference to the proxy used to invoke @endpoint. Proxies are
+   shared, so connections can be kept alive among invocations */
+static RestProxy *
+fetch_rest_get_proxy (GrlXmlFactorySource *source,
+                      RestData *rest,
+                      const gchar *endpoint)
+{
+  LruCache *proxies;
+  RestProxy *proxy;
+  gchar *proxy_key;
+
+  proxies = grl_xml_factory_source_get_rest_proxies (source);
+  if (rest->api_key) {
+    proxy_key = g_strdup_printf ("%s\n%s:%s",
+                                 endpoint,
+                                 rest->api_key,
+                                 rest->api_token? rest->api_token: "");
+  } else {
+    proxy_key = g_strdup (endpoint);
   }
 
-  GRL_XML_DUMP (data->fetch_data->dump,
-                content,
-                (gsize) rest_proxy_call_get_payload_length (call));
+  proxy = lru_cache_lookup (proxies, proxy_key);
+  if (proxy) {
+    g_free (proxy_key);
+    return g_object_ref (proxy);
+  }
 
-  data->callback (content, data->user_data, error);
-  if (error) {
-    g_error_free (error);
+  if (rest->api_key) {
+    proxy = oauth_proxy_new_with_token (rest->api_key,
+                                        rest->api_secret,
+                                        rest->api_token,
+                                        rest->api_token_secret,
+                                        endpoint,
+                                        FALSE);
+  } else {
+    proxy = rest_proxy_new (endpoint, FALSE);
   }
 
-  g_slice_free (NetProcessData, data);
+  if (rest->user_agent) {
+    rest_proxy_set_user_agent (proxy, rest->user_agent);
+  }
+
+  lru_cache_insert (proxies, proxy_key, g_object_ref (proxy));
+
+  return proxy;
 }
 
 static void
@@ -385,33 +792,36 @@ fetch_rest (GrlXmlFactorySource *source,
             DataFetchedCb send_callback,
             gpointer user_data)
 {
+  CachedResponse *response;
+  DataRef *revalidate = NULL;
   GError *call_error = NULL;
   GError *error;
   GList *parameters;
+  GString *request_key;
   NetProcessData *data;
   RestParameter *param;
   RestProxy *proxy;
   RestProxyCall *call;
+  RequestData *request;
   gchar *endpoint;
   gchar *use_function;
   gchar *use_referer;
   gchar *use_value;
 
   endpoint = expandable_string_get_value (fetch_data->data.rest->endpoint, expand_data);
-  if (fetch_data->data.rest->api_key) {
-    proxy = oauth_proxy_new_with_token (fetch_data->data.rest->api_key,
-                                        fetch_data->data.rest->api_secret,
-                                        fetch_data->data.rest->api_token,
-                                        fetch_data->data.rest->api_token_secret,
-                                        endpoint,
-                                        FALSE);
-  } else {
-    proxy = rest_proxy_new (endpoint, FALSE);
-  }
+  proxy = fetch_rest_get_proxy (source, fetch_data->data.rest, endpoint);
 
-  if (fetch_data->data.rest->user_agent) {
-    rest_proxy_set_user_agent (proxy, fetch_data->data.rest->user_agent);
+  /* Requests are identified by everything that takes part in the invocation */
+  request_key = g_string_new (fetch_data->data.rest->method);
+  g_string_append_c (request_key, '\n');
+  if (fetch_data->data.rest->api_key) {
+    g_string_append_printf (request_key,
+                            "%s:%s\n",
+                            fetch_data->data.rest->api_key,
+                            fetch_data->data.rest->api_token?
+                            fetch_data->data.rest->api_token: "");
   }
+  g_string_append (request_key, endpoint);
 
   call = rest_proxy_new_call (proxy);
 
@@ -422,6 +832,7 @@ fetch_rest (GrlXmlFactorySource *source,
       g_object_unref (call);
       g_object_unref (proxy);
       expandable_string_free_value (fetch_data->data.rest->endpoint, endpoint);
+      g_string_free (request_key, TRUE);
       return;
     }
 
@@ -432,7 +843,9 @@ fetch_rest (GrlXmlFactorySource *source,
                    use_function? use_function: "");
 
     rest_proxy_call_set_function (call, use_function);
-    expandable_string_free_value (fetch_data->data.rest->function, use_function);
+    g_string_append_c (request_key, '/');
+    g_string_append (request_key, use_function);
+    g_free (use_function);
   } else {
     GRL_XML_DEBUG (source,
                    debug_flag,
@@ -456,11 +869,13 @@ fetch_rest (GrlXmlFactorySource *source,
       send_callback (NULL, user_data, NULL);
       g_object_unref (call);
       g_object_unref (proxy);
+      g_string_free (request_key, TRUE);
       return;
     }
 
     rest_proxy_call_add_param (call, param->name, use_value);
-    expandable_string_free_value (param->value, use_value);
+    g_string_append_printf (request_key, "\n%s=%s", param->name, use_value);
+    g_free (use_value);
   }
 
   /* Expand the referer header */
@@ -474,34 +889,72 @@ fetch_rest (GrlXmlFactorySource *source,
       send_callback (NULL, user_data, NULL);
       g_object_unref (call);
       g_object_unref (proxy);
+      g_string_free (request_key, TRUE);
       return;
     }
 
     rest_proxy_call_add_header (call, "Referer", use_referer);
+    g_string_append_printf (request_key, "\nReferer: %s", use_referer);
     expandable_string_free_value (fetch_data->data.rest->referer,
                                   use_referer);
   }
 
+  if ((fetch_data->cache_time > 0 || fetch_data->negative_cache_time > 0) &&
+      fetch_cache_lookup (source,
+                          debug_flag,
+                          request_key->str,
+                          &revalidate,
+                          send_callback,
+                          user_data)) {
+    g_string_free (request_key, TRUE);
+    g_object_unref (call);
+    g_object_unref (proxy);
+    return;
+  }
+
   data = net_process_data_new ();
   data->fetch_data = fetch_data;
   data->source = g_object_ref (source);
   data->debug = debug_flag;
   data->callback = send_callback;
-  data->cancellable = cancellable;
+  data->cancellable = g_object_ref (cancellable);
   data->user_data = user_data;
 
-  rest_proxy_call_set_method (call, fetch_data->data.rest->method);
-
-  if (!rest_proxy_call_async (call,
-                              (RestProxyCallAsyncCallback) fetch_rest_fetched,
-                              NULL,
-                              data,
-                              &call_error)) {
-    g_slice_free (NetProcessData, data);
-    error = g_error_new (GRL_CORE_ERROR, 0, "Cannot invoke RESTful: %s", call_error->message);
-    send_callback (NULL, user_data, error);
-    g_error_free (call_error);
-    g_error_free (error);
+  request = request_attach (request_key->str, data);
+  g_string_free (request_key, TRUE);
+
+  if (request && revalidate) {
+    /* Ask only for a response newer than the cached one */
+    response = dataref_value (revalidate);
+    if (response->etag) {
+      rest_proxy_call_add_header (call, "If-None-Match", response->etag);
+    }
+    if (response->last_modified) {
+      rest_proxy_call_add_header (call, "If-Modified-Since", response->last_modified);
+    }
+    GRL_XML_DEBUG (source, debug_flag, "Revalidating cached response for '%s'",
+                   request->key);
+    request->revalidated = revalidate;
+  } else if (revalidate) {
+    dataref_unref (revalidate);
+  }
+
+  if (request) {
+    rest_proxy_call_set_method (call, fetch_data->data.rest->method);
+
+    if (!rest_proxy_call_async (call,
+                                (RestProxyCallAsyncCallback) fetch_rest_fetched,
+                                NULL,
+                                request,
+                                &call_error)) {
+      error = g_error_new (GRL_CORE_ERROR, 0, "Cannot invoke RESTful: %s", call_error->message);
+      request_done (request, NULL, 0, error);
+      g_error_free (call_error);
+      g_error_free (error);
+    } else {
+      /* Kept to be cancelled if all the waiters are cancelled */
+      request->call = g_object_ref (call);
+    }
   }
 
   g_object_unref (call);
@@ -580,16 +1033,36 @@ fetch_data_url_obtained (const gchar *url,
                          NetProcessData *data,
                          const GError *error)
 {
+  RequestData *request;
+
   if (error || !url || *url == '\0') {
     data->callback (NULL, data->user_data, error);
     net_process_data_free (data);
     return;
   }
 
+  if ((data->fetch_data->cache_time > 0 ||
+       data->fetch_data->negative_cache_time > 0) &&
+      fetch_cache_lookup (data->source,
+                          data->debug,
+                          url,
+                          NULL,
+                          data->callback,
+                          data->user_data)) {
+    net_process_data_free (data);
+    return;
+  }
+
+  request = request_attach (url, data);
+  if (!request) {
+    GRL_XML_DEBUG (data->source, data->debug, "Waiting for '%s' URL", url);
+    return;
+  }
+
   GRL_XML_DEBUG (data->source, data->debug, "Read '%s' URL", url);
-  grl_net_wc_request_async (data->wc, url, data->cancellable,
+  grl_net_wc_request_async (data->wc, url, request->cancellable,
                             (GAsyncReadyCallback) fetch_data_url_content_obtained,
-                            data);
+                            request);
 }
 
 RegExpInput *
@@ -625,6 +1098,9 @@ void
 reg_exp_expression_free (RegExpExpression *expression)
 {
   expandable_string_free (expression->expression);
+  if (expression->regex) {
+    g_regex_unref (expression->regex);
+  }
   g_slice_free (RegExpExpression, expression);
 }
 
@@ -643,7 +1119,7 @@ reg_exp_data_new ()
 void
 reg_exp_data_free (RegExpData *data)
 {
-  g_list_free_full (data->subregexp, (GDestroyNotify) reg_exp_data_free);
+  g_list_free_full (data->subregexp, (GDestroyNotify) fetch_data_free);
   reg_exp_input_free (data->input);
   expandable_string_free (data->output);
   g_free (data->output_id);
@@ -654,7 +1130,7 @@ reg_exp_data_free (RegExpData *data)
 ReplaceData *
 replace_data_new ()
 {
-  return g_slice_new (ReplaceData);
+  return g_slice_new0 (ReplaceData);
 }
 
 void
@@ -665,6 +1141,9 @@ replace_data_free (ReplaceData *data)
   }
   expandable_string_free (data->replacement);
   expandable_string_free (data->expression);
+  if (data->regex) {
+    g_regex_unref (data->regex);
+  }
   g_slice_free (ReplaceData, data);
 }
 
@@ -710,12 +1189,41 @@ rest_data_free (RestData *data)
 
   expandable_string_free (data->endpoint);
   expandable_string_free (data->function);
+  expandable_string_free (data->referer);
 
   g_list_free_full (data->parameters, (GDestroyNotify) rest_parameter_free);
 
   g_slice_free (RestData, data);
 }
 
+/* Expressions that do not need to be expanded are compiled only once */
+GRegex *
+fetch_expression_compile (ExpandableString *expression)
+{
+  GError *error = NULL;
+  GRegex *regex;
+  gchar *pattern;
+
+  if (!expression ||
+      expandable_string_get_dependencies (expression) != 0) {
+    return NULL;
+  }
+
+  pattern = expandable_string_get_value (expression, NULL);
+  if (!pattern) {
+    return NULL;
+  }
+
+  regex = g_regex_new (pattern, G_REGEX_OPTIMIZE, 0, &error);
+  if (!regex) {
+    GRL_DEBUG ("Wrong expression '%s': %s", pattern, error->message);
+    g_error_free (error);
+  }
+  expandable_string_free_value (expression, pattern);
+
+  return regex;
+}
+
 FetchData *
 fetch_data_new ()
 {
@@ -749,6 +1257,102 @@ fetch_data_free (FetchData *data)
   g_slice_free (FetchData, data);
 }
 
+/* Sets the time responses, and failed or empty responses, are cached to all
+   the URL and RESTful invocations that do not specify it */
+void
+fetch_data_set_cache_time (FetchData *data,
+                           guint cache_time,
+                           guint negative_cache_time)
+{
+  GList *subregexp;
+
+  if (!data) {
+    return;
+  }
+
+  switch (data->type) {
+  case FETCH_URL:
+    if (data->cache_time == 0) {
+      data->cache_time = cache_time;
+    }
+    if (data->negative_cache_time == 0) {
+      data->negative_cache_time = negative_cache_time;
+    }
+    fetch_data_set_cache_time (data->data.url, cache_time, negative_cache_time);
+    break;
+  case FETCH_REST:
+    if (data->cache_time == 0) {
+      data->cache_time = cache_time;
+    }
+    if (data->negative_cache_time == 0) {
+      data->negative_cache_time = negative_cache_time;
+    }
+    break;
+  case FETCH_REPLACE:
+    fetch_data_set_cache_time (data->data.replace->input,
+                               cache_time,
+                               negative_cache_time);
+    break;
+  case FETCH_REGEXP:
+    for (subregexp = data->data.regexp->subregexp;
+         subregexp;
+         subregexp = g_list_next (subregexp)) {
+      fetch_data_set_cache_time (subregexp->data,
+                                 cache_time,
+                                 negative_cache_time);
+    }
+    if (!data->data.regexp->input->use_ref) {
+      fetch_data_set_cache_time (data->data.regexp->input->data.input,
+                                 cache_time,
+                                 negative_cache_time);
+    }
+    break;
+  }
+}
+
+/* Invokes @func for each string that is obtained through GetRawCb */
+void
+fetch_data_foreach_raw (FetchData *data,
+                        FetchRawFunc func,
+                        gpointer user_data)
+{
+  GList *l;
+
+  if (!data) {
+    return;
+  }
+
+  switch (data->type) {
+  case FETCH_RAW:
+    func (data->data.raw, user_data);
+    break;
+  case FETCH_URL:
+    fetch_data_foreach_raw (data->data.url, func, user_data);
+    break;
+  case FETCH_REST:
+    if (data->data.rest->function) {
+      func (data->data.rest->function, user_data);
+    }
+    for (l = data->data.rest->parameters; l; l = g_list_next (l)) {
+      func (((RestParameter *) l->data)->value, user_data);
+    }
+    break;
+  case FETCH_REPLACE:
+    fetch_data_foreach_raw (data->data.replace->input, func, user_data);
+    break;
+  case FETCH_REGEXP:
+    for (l = data->data.regexp->subregexp; l; l = g_list_next (l)) {
+      fetch_data_foreach_raw (l->data, func, user_data);
+    }
+    if (!data->data.regexp->input->use_ref) {
+      fetch_data_foreach_raw (data->data.regexp->input->data.input,
+                              func,
+                              user_data);
+    }
+    break;
+  }
+}
+
 void
 fetch_data_get (GrlXmlFactorySource *source,
                 GrlXmlDebug debug_flag,
@@ -776,7 +1380,7 @@ fetch_data_get (GrlXmlFactorySource *source,
     use_raw = get_raw_callback (source, fetch_data->data.raw, get_raw_data);
     GRL_XML_DEBUG (source, debug_flag, "Use '%s'", use_raw);
     send_callback (use_raw, user_data, NULL);
-    expandable_string_free_value (fetch_data->data.raw, use_raw);
+    g_free (use_raw);
     return;
   }
 
@@ -865,3 +1469,110 @@ fetch_data_get (GrlXmlFactorySource *source,
                   user_data);
   }
 }
+
+static void
+fetch_key_append_string (GString *key,
+                         ExpandableString *exp_str,
+                         ExpandData *expand_data)
+{
+  gchar *value;
+
+  if (exp_str) {
+    value = expandable_string_get_value (exp_str, expand_data);
+    if (value) {
+      g_string_append (key, value);
+    }
+    expandable_string_free_value (exp_str, value);
+  }
+  g_string_append_c (key, '\n');
+}
+
+static gboolean
+fetch_key_append_data (GString *key,
+                       FetchData *data,
+                       ExpandData *expand_data)
+{
+  GList *l;
+  RegExpData *regexp;
+  RestData *rest;
+  RestParameter *param;
+
+  if (!data) {
+    g_string_append (key, "-\n");
+    return TRUE;
+  }
+
+  g_string_append_printf (key, "%d\n", data->type);
+
+  switch (data->type) {
+  case FETCH_SCRIPT:
+    /* Scripts could give a different result each time */
+    return FALSE;
+  case FETCH_RAW:
+    fetch_key_append_string (key, data->data.raw, expand_data);
+    break;
+  case FETCH_URL:
+    return fetch_key_append_data (key, data->data.url, expand_data);
+  case FETCH_REST:
+    rest = data->data.rest;
+    g_string_append_printf (key,
+                            "%s\n%s:%s\n",
+                            rest->method,
+                            rest->api_key? rest->api_key: "",
+                            rest->api_token? rest->api_token: "");
+    fetch_key_append_string (key, rest->endpoint, expand_data);
+    fetch_key_append_string (key, rest->function, expand_data);
+    for (l = rest->parameters; l; l = g_list_next (l)) {
+      param = (RestParameter *) l->data;
+      g_string_append_printf (key, "%s=", param->name);
+      fetch_key_append_string (key, param->value, expand_data);
+    }
+    fetch_key_append_string (key, rest->referer, expand_data);
+    break;
+  case FETCH_REPLACE:
+    fetch_key_append_string (key, data->data.replace->expression, expand_data);
+    fetch_key_append_string (key, data->data.replace->replacement, expand_data);
+    return fetch_key_append_data (key, data->data.replace->input, expand_data);
+  case FETCH_REGEXP:
+    regexp = data->data.regexp;
+    for (l = regexp->subregexp; l; l = g_list_next (l)) {
+      if (!fetch_key_append_data (key, l->data, expand_data)) {
+        return FALSE;
+      }
+    }
+    g_string_append_printf (key,
+                            "%d:%d:%s\n",
+                            regexp->expression->repeat,
+                            regexp->input->decode,
+                            regexp->output_id? regexp->output_id: "");
+    fetch_key_append_string (key, regexp->expression->expression, expand_data);
+    fetch_key_append_string (key, regexp->output, expand_data);
+    if (regexp->input->use_ref) {
+      g_string_append_printf (key, "%s\n", regexp->input->data.buffer_id);
+    } else {
+      return fetch_key_append_data (key, regexp->input->data.input, expand_data);
+    }
+    break;
+  }
+
+  return TRUE;
+}
+
+/* Returns a string that identifies the content @data obtains once expanded
+   with @expand_data, to use as a cache key; strings obtained through GetRawCb
+   are expanded with @expand_data too. Returns %NULL if the content can not be
+   identified, as when scripts are involved. Free it with g_free() */
+gchar *
+fetch_data_get_key (FetchData *data,
+                    ExpandData *expand_data)
+{
+  GString *key;
+
+  key = g_string_new (NULL);
+  if (!fetch_key_append_data (key, data, expand_data)) {
+    g_string_free (key, TRUE);
+    return NULL;
+  }
+
+  return g_string_free (key, FALSE);
+}
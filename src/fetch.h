@@ -44,15 +44,20 @@ typedef void (*DataFetchedCb) (const gchar *content,
                                gpointer user_data,
                                const GError *error);
 
+/* Returns a newly allocated string */
 typedef gchar *(*GetRawCb) (GrlXmlFactorySource *source,
                             ExpandableString *raw,
                             DataRef *data);
 
+typedef void (*FetchRawFunc) (ExpandableString *raw,
+                              gpointer user_data);
+
 typedef struct _FetchData FetchData;
 
 typedef struct _RegExpExpression {
   gboolean repeat;
   ExpandableString *expression;
+  GRegex *regex;
 } RegExpExpression;
 
 typedef struct _RegExpInput {
@@ -76,6 +81,7 @@ typedef struct _ReplaceData {
   FetchData *input;
   ExpandableString *replacement;
   ExpandableString *expression;
+  GRegex *regex;
 } ReplaceData;
 
 typedef struct _RestParameter {
@@ -98,6 +104,8 @@ typedef struct _RestData {
 
 struct _FetchData {
   LogDumpData *dump;
+  guint cache_time;
+  guint negative_cache_time;
   gint type;
   union {
     ExpandableString *raw;
@@ -133,10 +141,23 @@ RestData *rest_data_new (void);
 
 void rest_data_free (RestData *data);
 
+GRegex *fetch_expression_compile (ExpandableString *expression);
+
 FetchData *fetch_data_new (void);
 
 void fetch_data_free (FetchData *data);
 
+void fetch_data_set_cache_time (FetchData *data,
+                                guint cache_time,
+                                guint negative_cache_time);
+
+void fetch_data_foreach_raw (FetchData *data,
+                             FetchRawFunc func,
+                             gpointer user_data);
+
+gchar *fetch_data_get_key (FetchData *data,
+                           ExpandData *expand_data);
+
 void
 fetch_data_get (GrlXmlFactorySource *source,
                 GrlXmlDebug debug_flag,
@@ -31,8 +31,11 @@
 #include "dataref.h"
 #include "expandable-string.h"
 #include "fetch.h"
-#include "json-ghashtable.h"
+#include "json-query.h"
 #include "log.h"
+#include "lru-cache.h"
+#include "operation-index.h"
+#include "private-keys.h"
 
 #include <json-glib/json-glib.h>
 #include <lauxlib.h>
@@ -55,6 +58,38 @@
 #define STR_HAS_VALUE(string)                   \
   ((string) && (string)[0] != '\0')
 
+/* Maximum number of compiled regular expressions kept for expanded
+   expressions */
+#define REGEX_CACHE_SIZE 64
+
+/* Maximum number of compiled XPath expressions kept for expanded paths */
+#define XPATH_CACHE_SIZE 64
+
+/* Maximum number of compiled JSONPath expressions kept for expanded paths */
+#define JSON_PATH_CACHE_SIZE 64
+
+/* Maximum number of RESTful proxies kept alive */
+#define REST_PROXY_CACHE_SIZE 16
+
+/* Maximum amount of memory (in bytes) used to cache responses */
+#define RESPONSE_CACHE_SIZE (4 * 1024 * 1024)
+
+/* Default maximum amount of memory (in bytes) used by the parsed results
+   cached by all the sources; it can be changed with "cache-size" (in KiB) in
+   the plugin configuration */
+#define RESULT_CACHE_SIZE (16 * 1024 * 1024)
+
+/* Approximate memory (in bytes) used by each JSON node */
+#define JSON_NODE_SIZE 64
+
+/* Seconds an expired parsed result is kept, so it can be reused if the
+   content fetched again has not changed */
+#define RESULT_REVALIDATE_TIME (24 * 60 * 60)
+
+/* Default maximum number of items of a page that are resolved at the same
+   time, to get their use="resolve" keys */
+#define MAX_RESOLVES 4
+
 /* Executes "call(data)" in a idle if options contains GRL_RESOLVE_IDLE_RELAY
    flag; else, it invokes the call directly */
 #define EXECUTE_CALL(options, call, data)                               \
@@ -77,6 +112,12 @@ enum {
 enum {
   FORMAT_XML,
   FORMAT_JSON,
+  FORMAT_LAST,
+};
+
+enum {
+  PROP_0,
+  PROP_CACHE_USAGE,
 };
 
 typedef void (*SendResultCb) (GrlMedia *media,
@@ -93,14 +134,32 @@ typedef struct _ResultData {
   guint refcount;
   FetchData *query;
   gint format;
-  gint cache_time;
-  gboolean cache_valid;
-  union {
-    DataRef *xml;
-    JsonParser *json;
-  } cache;
+  guint cache_time;
+  guint stale_time;
+  guint negative_cache_time;
 } ResultData;
 
+/* A parsed result, shared among the operations requesting the same query. A
+   result that could not be parsed is cached too, without document nor
+   parser. The checksum of the content it was parsed from allows to reuse it
+   once expired */
+typedef struct _CachedResult {
+  DataRef *xml_doc_reffed;
+  JsonParser *json_parser;
+  gchar *checksum;
+} CachedResult;
+
+/* Refresh of a cached result that has expired, done in background */
+typedef struct _RefreshData {
+  GrlXmlFactorySource *source;
+  ResultData *result;
+  gchar *key;
+  ExpandData *expand_data;
+  GCancellable *cancellable;
+  CachedResult *previous;
+  gint64 start_time;
+} RefreshData;
+
 typedef struct _Operation {
   glong line_number;
   gchar *id;
@@ -108,46 +167,60 @@ typedef struct _Operation {
   ExpandableString *count;
   GrlKeyID resolve_key;
   gboolean resolve_any;
+  gboolean unordered;
   GList *requirements;
   GType required_type;
   ResultData *result;
 } Operation;
 
-typedef struct _NameSpace {
-  xmlChar *prefix;
-  xmlChar *href;
-} NameSpace;
-
 typedef struct _PrivateData {
   gchar *name;
   ExpandableString *data;
 } PrivateData;
 
+/* Key whose value is read directly from the items, without fetching it: a
+   child element or attribute (XML), or a simple JSONPath (JSON) */
+typedef struct _DirectKey {
+  GrlKeyID key;
+  gboolean attribute;
+  xmlChar *name;
+  xmlChar *href;
+  JsonQuery *json_query;
+} DirectKey;
+
 typedef struct _MediaTemplate {
   glong line_number;
   gchar *operation_id;
   GType media_type;
   gint format;
-  NameSpace *namespace;
-  gint namespace_size;
+  xmlXPathContextPtr xml_ctx;
   ExpandableString *query;
   ExpandableString *select;
   GHashTable *keys;
   GList *mandatory_keys;
   GList *private_keys;
+  GHashTable *paths;
+  GHashTable *direct_keys;
 } MediaTemplate;
 
 typedef struct _GetRawData {
   DataRef *xpath_reffed;
-  DataRef *xml_ctx_reffed;
   DataRef *xml_doc_reffed;
+  xmlXPathContextPtr xml_ctx;
   gint node;
-  NameSpace *namespace;
-  gint namespace_size;
-  JsonArray *json_array;
+  GHashTable *paths;
+  DataRef *json_items_reffed;
   ExpandData *expand_data;
 } GetRawData;
 
+/* Nodes of a JSON result that match a template. They are not copied, so the
+   parser is kept alive while they are used */
+typedef struct _JsonItems {
+  JsonParser *parser;
+  JsonNode *matches;
+  GPtrArray *nodes;
+} JsonItems;
+
 typedef struct _OperationCallData {
   GrlXmlFactorySource *source;
   Operation *operation;
@@ -158,10 +231,16 @@ typedef struct _OperationCallData {
   GrlOperationOptions *options;
   DataRef *xml_doc_reffed;
   JsonParser *json_parser;
+  gchar *result_key;
+  CachedResult *previous;
+  gint64 start_time;
   ExpandData *expand_data;
   guint skip;
   guint count;
-  GList *send_list;
+  GPtrArray *send_queue;
+  guint send_head;
+  GQueue resolve_queue;
+  guint resolving;
   gint total_results;
   gpointer user_data;
 } OperationCallData;
@@ -181,18 +260,29 @@ typedef struct _FetchItemData {
 struct _GrlXmlFactorySourcePrivate {
   GHashTable *results;
   GList *operations[OP_LAST];
+  GrlKeyID operations_key[OP_LAST];
+  OperationIndex *operations_index[OP_LAST];
   GList *supported_keys;
   GList *slow_keys;
   GList *use_resolve_keys;
   GList *media_templates;
+  GList *generic_templates[FORMAT_LAST];
+  GHashTable *operation_templates[FORMAT_LAST];
   GList *located_strings;
   GrlConfig *config;
   GrlNetWc *wc;
   gchar *user_agent;
   GrlXmlDebug debug;
   gint autosplit;
+  guint max_resolves;
   GrlKeyID private_keys_key;
   lua_State *lua_state;
+  LruCache *regex_cache;
+  Cache *response_cache;
+  GHashTable *requests;
+  LruCache *rest_proxies;
+  LruCache *xpath_cache;
+  LruCache *json_path_cache;
 };
 
 gboolean grl_xml_factory_plugin_init (GrlRegistry *registry,
@@ -229,10 +319,26 @@ static void grl_xml_factory_source_search (GrlSource *source,
 static void grl_xml_factory_source_cancel (GrlSource *source,
                                            guint operation_id);
 
+static void grl_xml_factory_source_get_property (GObject *object,
+                                                 guint prop_id,
+                                                 GValue *value,
+                                                 GParamSpec *pspec);
+
 static void operation_free (Operation *operation);
 
 static void media_template_free (MediaTemplate *template);
 
+static void media_templates_build_index (GrlXmlFactorySource *source);
+
+static gsize get_result_cache_size (GList *configs);
+
+static gsize json_get_size (JsonNode *node);
+
+static void cached_result_free (CachedResult *result);
+
+static void operations_build_index (GrlXmlFactorySource *source,
+                                    gint type);
+
 static void merge_config (GList *options,
                           GrlConfig *into,
                           GrlConfig *from);
@@ -258,6 +364,9 @@ static OperationCallData * get_resolve_data (GrlXmlFactorySource *source,
 
 static void operation_call_send_list_run (OperationCallData *data);
 
+static void operation_call_send_item_done (OperationCallData *data,
+                                           SendItem *send_item);
+
 static void operation_call (OperationCallData *data);
 
 static xmlSchemaPtr get_xml_schema (void);
@@ -312,6 +421,12 @@ void handle_schema_warnings (void *ctx,
 
 GrlKeyID GRL_METADATA_KEY_PRIVATE_KEYS = 0;
 
+/* Parsed results cached by all the sources */
+static Cache *result_cache = NULL;
+
+/* Keys of the cached results being refreshed */
+static GHashTable *refreshing_results = NULL;
+
 /* =================== XML Factory Plugin  =============== */
 
 
@@ -372,6 +487,9 @@ grl_xml_factory_plugin_init (GrlRegistry *registry,
 
   g_strfreev (supported_versions);
 
+  result_cache = cache_new (get_result_cache_size (configs),
+                            (GDestroyNotify) cached_result_free);
+
   if (!source_xml_specs) {
     xmlSchemaFree (source_schema);
     return TRUE;
@@ -395,8 +513,18 @@ grl_xml_factory_plugin_init (GrlRegistry *registry,
   return source_loaded;
 }
 
+static void
+grl_xml_factory_plugin_deinit (GrlPlugin *plugin)
+{
+  g_clear_pointer (&result_cache, (GDestroyNotify) cache_free);
+  if (refreshing_results) {
+    g_hash_table_unref (refreshing_results);
+    refreshing_results = NULL;
+  }
+}
+
 GRL_PLUGIN_REGISTER (grl_xml_factory_plugin_init,
-                     NULL,
+                     grl_xml_factory_plugin_deinit,
                      XML_FACTORY_PLUGIN_ID);
 
 G_DEFINE_TYPE (GrlXmlFactorySource,
@@ -407,13 +535,25 @@ static void
 grl_xml_factory_source_finalize (GObject *object)
 {
   GrlXmlFactorySource *self = GRL_XML_FACTORY_SOURCE (object);
+  gint i;
 
   g_list_free (self->priv->supported_keys);
   g_list_free (self->priv->slow_keys);
   g_list_free (self->priv->use_resolve_keys);
+  for (i = 0; i < FORMAT_LAST; i++) {
+    g_list_free (self->priv->generic_templates[i]);
+    if (self->priv->operation_templates[i]) {
+      g_hash_table_unref (self->priv->operation_templates[i]);
+    }
+  }
   g_list_free_full (self->priv->media_templates,
                     (GDestroyNotify) media_template_free);
 
+  for (i = 0; i < OP_LAST; i++) {
+    if (self->priv->operations_index[i]) {
+      operation_index_free (self->priv->operations_index[i]);
+    }
+  }
   g_list_free_full (self->priv->operations[OP_SEARCH], (GDestroyNotify) operation_free);
   g_list_free_full (self->priv->operations[OP_BROWSE], (GDestroyNotify) operation_free);
   g_list_free_full (self->priv->operations[OP_RESOLVE], (GDestroyNotify) operation_free);
@@ -432,6 +572,19 @@ grl_xml_factory_source_finalize (GObject *object)
     lua_close (self->priv->lua_state);
   }
 
+  lru_cache_free (self->priv->regex_cache);
+  cache_free (self->priv->response_cache);
+  if (result_cache) {
+    cache_remove_owner (result_cache, self);
+  }
+  lru_cache_free (self->priv->rest_proxies);
+  lru_cache_free (self->priv->xpath_cache);
+  lru_cache_free (self->priv->json_path_cache);
+
+  if (self->priv->requests) {
+    g_hash_table_unref (self->priv->requests);
+  }
+
   G_OBJECT_CLASS (grl_xml_factory_source_parent_class)->finalize (object);
 }
 
@@ -461,6 +614,7 @@ grl_xml_factory_source_class_init (GrlXmlFactorySourceClass * klass)
 
   g_class->finalize = grl_xml_factory_source_finalize;
   g_class->dispose = grl_xml_factory_source_dispose;
+  g_class->get_property = grl_xml_factory_source_get_property;
 
   source_class->supported_keys = grl_xml_factory_source_supported_keys;
   source_class->slow_keys = grl_xml_factory_source_slow_keys;
@@ -471,15 +625,44 @@ grl_xml_factory_source_class_init (GrlXmlFactorySourceClass * klass)
   source_class->resolve = grl_xml_factory_source_resolve;
   source_class->may_resolve = grl_xml_factory_source_may_resolve;
 
+  /* Amount of memory used by the parsed results of the source in the cache
+     shared by all the sources */
+  g_object_class_install_property (g_class,
+                                   PROP_CACHE_USAGE,
+                                   g_param_spec_uint64 ("cache-usage",
+                                                        "Cache usage",
+                                                        "Memory used by the cached results",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_STATIC_STRINGS));
+
   g_type_class_add_private (klass, sizeof (GrlXmlFactorySourcePrivate));
 }
 
+static void
+grl_xml_factory_source_get_property (GObject *object,
+                                     guint prop_id,
+                                     GValue *value,
+                                     GParamSpec *pspec)
+{
+  switch (prop_id) {
+  case PROP_CACHE_USAGE:
+    g_value_set_uint64 (value,
+                        result_cache? cache_get_owner_size (result_cache, object): 0);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
 static void
 grl_xml_factory_source_init (GrlXmlFactorySource *source)
 {
   source->priv = GRL_XML_FACTORY_SOURCE_GET_PRIVATE (source);
 
   source->priv->wc = grl_net_wc_new ();
+  source->priv->max_resolves = MAX_RESOLVES;
 }
 
 static GrlXmlFactorySource *
@@ -517,9 +700,11 @@ grl_xml_factory_source_new (const gchar *xml_spec_path,
   gint api_version;
   gint autosplit = 0;
   gint i;
+  gint max_resolves = 0;
   lua_State *lua_state = NULL;
   xmlChar *api_version_str;
   xmlChar *autosplit_str;
+  xmlChar *max_resolves_str;
   xmlDocPtr xml_doc;
   xmlNodePtr xml_config = NULL;
   xmlNodePtr xml_node;
@@ -593,6 +778,13 @@ grl_xml_factory_source_new (const gchar *xml_spec_path,
   }
   xmlFree (autosplit_str);
 
+  /* Get maximum number of simultaneous resolves, if defined */
+  max_resolves_str = xmlGetProp (xml_node, (const xmlChar *) "max-resolves");
+  if (STR_HAS_VALUE (max_resolves_str)) {
+    max_resolves = (gint) g_ascii_strtoll ((const gchar *) max_resolves_str, NULL, 10);
+  }
+  xmlFree (max_resolves_str);
+
   /* Get user-agent property, if defined */
   user_agent = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "user-agent");
   if (!STR_HAS_VALUE (user_agent)) {
@@ -688,6 +880,10 @@ grl_xml_factory_source_new (const gchar *xml_spec_path,
   source->priv->located_strings = located_strings;
   source->priv->lua_state = lua_state;
 
+  if (max_resolves > 0) {
+    source->priv->max_resolves = max_resolves;
+  }
+
   if (user_agent) {
     source->priv->user_agent = user_agent;
     g_object_set (G_OBJECT (source->priv->wc), "user-agent", user_agent, NULL);
@@ -708,6 +904,8 @@ grl_xml_factory_source_new (const gchar *xml_spec_path,
     xml_spec_get_operation (source, xml_operation);
     xml_operation = xml_get_node (xml_operation->next);
   }
+  operations_build_index (source, OP_BROWSE);
+  operations_build_index (source, OP_RESOLVE);
 
 
   /* Get all the keys involved in requirements to make them "force" keys.
@@ -760,6 +958,7 @@ grl_xml_factory_source_new (const gchar *xml_spec_path,
     xml_provide = xml_get_node (xml_provide->next);
   }
   source->priv->media_templates = g_list_reverse (source->priv->media_templates);
+  media_templates_build_index (source);
 
   g_hash_table_unref (required_keys);
 
@@ -958,9 +1157,6 @@ result_data_unref (ResultData *data)
     if (data->query) {
       fetch_data_free (data->query);
     }
-    if (data->cache.xml) {
-      (data->format == FORMAT_XML)? dataref_unref (data->cache.xml): g_object_unref (data->cache.json);
-    }
     g_slice_free (ResultData, data);
   }
 }
@@ -1004,6 +1200,14 @@ private_data_free (PrivateData *data)
   g_slice_free (PrivateData, data);
 }
 
+static void
+direct_key_free (DirectKey *direct)
+{
+  xmlFree (direct->name);
+  xmlFree (direct->href);
+  g_slice_free (DirectKey, direct);
+}
+
 static MediaTemplate *
 media_template_new (void)
 {
@@ -1021,15 +1225,9 @@ media_template_new (void)
 static void
 media_template_free (MediaTemplate *template)
 {
-  int i;
-
   g_free (template->operation_id);
-  if (template->namespace) {
-    for (i = 0; i < template->namespace_size; i++) {
-      xmlFree (template->namespace[i].prefix);
-      xmlFree (template->namespace[i].href);
-    }
-    g_free (template->namespace);
+  if (template->xml_ctx) {
+    xmlXPathFreeContext (template->xml_ctx);
   }
 
   expandable_string_free (template->query);
@@ -1037,6 +1235,12 @@ media_template_free (MediaTemplate *template)
   g_hash_table_unref (template->keys);
   g_list_free (template->mandatory_keys);
   g_list_free_full (template->private_keys, (GDestroyNotify) private_data_free);
+  if (template->paths) {
+    g_hash_table_unref (template->paths);
+  }
+  if (template->direct_keys) {
+    g_hash_table_unref (template->direct_keys);
+  }
 
   g_slice_free (MediaTemplate, template);
 }
@@ -1052,17 +1256,157 @@ get_raw_data_free (GetRawData *data)
 {
   if (data->xml_doc_reffed) {
     dataref_unref (data->xpath_reffed);
-    dataref_unref (data->xml_ctx_reffed);
     dataref_unref (data->xml_doc_reffed);
   }
-  if (data->json_array) {
-    json_array_unref (data->json_array);
+  if (data->json_items_reffed) {
+    dataref_unref (data->json_items_reffed);
   }
 
   expand_data_unref (data->expand_data);
   g_slice_free (GetRawData, data);
 }
 
+static JsonItems *
+json_items_new (JsonParser *parser)
+{
+  JsonItems *items;
+
+  items = g_slice_new0 (JsonItems);
+  items->parser = g_object_ref (parser);
+  items->nodes = g_ptr_array_new ();
+
+  return items;
+}
+
+static void
+json_items_free (JsonItems *items)
+{
+  g_ptr_array_free (items->nodes, TRUE);
+  if (items->matches) {
+    json_node_free (items->matches);
+  }
+  g_object_unref (items->parser);
+  g_slice_free (JsonItems, items);
+}
+
+static CachedResult *
+cached_result_new (DataRef *xml_doc_reffed,
+                   JsonParser *json_parser,
+                   const gchar *checksum)
+{
+  CachedResult *result;
+
+  result = g_slice_new0 (CachedResult);
+  if (xml_doc_reffed) {
+    result->xml_doc_reffed = dataref_ref (xml_doc_reffed);
+  }
+  if (json_parser) {
+    result->json_parser = g_object_ref (json_parser);
+  }
+  result->checksum = g_strdup (checksum);
+
+  return result;
+}
+
+static gsize
+xml_node_get_size (xmlNodePtr node)
+{
+  gsize size = 0;
+  xmlAttrPtr attr;
+
+  for (; node; node = node->next) {
+    size += sizeof (xmlNode) + xmlStrlen (node->content);
+    if (node->type == XML_ELEMENT_NODE) {
+      for (attr = node->properties; attr; attr = attr->next) {
+        size += sizeof (xmlAttr) + xml_node_get_size (attr->children);
+      }
+    }
+    size += xml_node_get_size (node->children);
+  }
+
+  return size;
+}
+
+static void
+json_add_member_size (JsonObject *object,
+                      const gchar *member_name,
+                      JsonNode *member_node,
+                      gsize *size)
+{
+  *size += strlen (member_name) + json_get_size (member_node);
+}
+
+static void
+json_add_element_size (JsonArray *array,
+                       guint index,
+                       JsonNode *element_node,
+                       gsize *size)
+{
+  *size += json_get_size (element_node);
+}
+
+/* Returns the approximate amount of memory used by @node */
+static gsize
+json_get_size (JsonNode *node)
+{
+  gsize size = JSON_NODE_SIZE;
+
+  switch (json_node_get_node_type (node)) {
+  case JSON_NODE_OBJECT:
+    json_object_foreach_member (json_node_get_object (node),
+                                (JsonObjectForeach) json_add_member_size,
+                                &size);
+    break;
+  case JSON_NODE_ARRAY:
+    json_array_foreach_element (json_node_get_array (node),
+                                (JsonArrayForeach) json_add_element_size,
+                                &size);
+    break;
+  case JSON_NODE_VALUE:
+    if (json_node_get_value_type (node) == G_TYPE_STRING) {
+      size += strlen (json_node_get_string (node));
+    }
+    break;
+  default:
+    break;
+  }
+
+  return size;
+}
+
+/* Returns the approximate amount of memory used by the parsed result */
+static gsize
+cached_result_get_size (CachedResult *result)
+{
+  JsonNode *root;
+  gsize size;
+  xmlDocPtr xml_doc;
+
+  size = result->checksum? strlen (result->checksum): 0;
+
+  if (result->xml_doc_reffed) {
+    xml_doc = dataref_value (result->xml_doc_reffed);
+    return size + sizeof (xmlDoc) + xml_node_get_size (xml_doc->children);
+  }
+
+  if (!result->json_parser) {
+    return size;
+  }
+
+  root = json_parser_get_root (result->json_parser);
+
+  return root? size + json_get_size (root): size;
+}
+
+static void
+cached_result_free (CachedResult *result)
+{
+  g_clear_pointer (&result->xml_doc_reffed, (GDestroyNotify) dataref_unref);
+  g_clear_object (&result->json_parser);
+  g_free (result->checksum);
+  g_slice_free (CachedResult, result);
+}
+
 inline static OperationCallData *
 operation_call_data_new (void)
 {
@@ -1073,8 +1417,15 @@ inline static void
 operation_call_data_free (OperationCallData *data)
 {
   g_clear_pointer (&data->xml_doc_reffed, (GDestroyNotify) dataref_unref);
+  g_clear_object (&data->json_parser);
+  g_free (data->result_key);
+  g_clear_pointer (&data->previous, (GDestroyNotify) cached_result_free);
   g_clear_pointer (&data->expand_data, (GDestroyNotify) expand_data_unref);
   g_clear_object (&data->cancellable);
+  if (data->send_queue) {
+    g_ptr_array_free (data->send_queue, TRUE);
+  }
+  g_queue_clear (&data->resolve_queue);
 
   g_slice_free (OperationCallData, data);
 }
@@ -1167,6 +1518,31 @@ merge_all_configs (const gchar *source_id,
   return merged_config;
 }
 
+/* Returns the memory budget for the parsed results, from the "cache-size"
+   option (in KiB) of the plugin configuration not bound to a source */
+static gsize
+get_result_cache_size (GList *configs)
+{
+  GrlConfig *config;
+  gchar *config_source_id;
+  gint cache_size;
+
+  for (; configs; configs = g_list_next (configs)) {
+    config = (GrlConfig *) configs->data;
+    config_source_id = grl_config_get_source (config);
+    if (!config_source_id &&
+        grl_config_has_param (config, "cache-size")) {
+      cache_size = grl_config_get_int (config, "cache-size");
+      if (cache_size >= 0) {
+        return (gsize) cache_size * 1024;
+      }
+    }
+    g_free (config_source_id);
+  }
+
+  return RESULT_CACHE_SIZE;
+}
+
 static gboolean
 all_options_have_value (GList *options,
                         GrlConfig *config)
@@ -1292,14 +1668,6 @@ get_source_xml_specs ()
   return g_list_reverse (xml_specs);
 }
 
-static gboolean
-cache_expired_cb (ResultData *result)
-{
-  result->cache_valid = FALSE;
-
-  return FALSE;
-}
-
 /* Returns the first node, skipping all the comments */
 static xmlNodePtr
 xml_get_node (xmlNodePtr xml_node)
@@ -1409,7 +1777,8 @@ xml_spec_get_rest (GrlXmlFactorySource *source,
   }
   xmlFree (xmlCharMethod);
 
-  /* Check what is the endpoint, and check if we already have a RestProxy for it */
+  /* Check what is the endpoint; proxies are shared among all the invocations
+     of the same endpoint */
   needs_oauth = xml_get_property_boolean (xml_node, (const xmlChar *) "oauth");
   unexpanded_endpoint = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "endpoint");
   endpoint = expandable_string_new ((const gchar *) unexpanded_endpoint,
@@ -1432,10 +1801,6 @@ xml_spec_get_rest (GrlXmlFactorySource *source,
 
     api_token = grl_config_get_api_token (source->priv->config);
     api_token_secret = grl_config_get_api_token_secret (source->priv->config);
-    g_free (api_key);
-    g_free (api_secret);
-    g_free (api_token);
-    g_free (api_token_secret);
   }
 
   rest_data = rest_data_new ();
@@ -1547,6 +1912,7 @@ xml_spec_get_regexp (GrlXmlFactorySource *source,
   if (xml_node) {
     regexp->expression->expression = xml_spec_get_expandable_string (source, xml_node);
     regexp->expression->repeat = xml_get_property_boolean (xml_node, (const xmlChar *) "repeat");
+    regexp->expression->regex = fetch_expression_compile (regexp->expression->expression);
   }
 
   return regexp;
@@ -1581,6 +1947,7 @@ xml_spec_get_replace (GrlXmlFactorySource *source,
 
   /* Get the expression */
   replace_data->expression = xml_spec_get_expandable_string (source, xml_node);
+  replace_data->regex = fetch_expression_compile (replace_data->expression);
 
   return replace_data;
 }
@@ -1596,6 +1963,7 @@ xml_spec_get_fetch_data (GrlXmlFactorySource *source,
   RegExpData *regexp_data = NULL;
   ReplaceData *replace_data = NULL;
   RestData *rest_data = NULL;
+  gchar *cache_time;
   gchar *dump_file;
 
   /* Check if there is result */
@@ -1672,6 +2040,20 @@ xml_spec_get_fetch_data (GrlXmlFactorySource *source,
     g_free (dump_file);
   }
 
+  /* Get the time responses are cached */
+  if (url_data || rest_data) {
+    cache_time = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "cache");
+    if (STR_HAS_VALUE (cache_time)) {
+      data->cache_time = (guint) g_ascii_strtoull (cache_time, NULL, 10);
+    }
+    g_free (cache_time);
+    cache_time = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "negative-cache");
+    if (STR_HAS_VALUE (cache_time)) {
+      data->negative_cache_time = (guint) g_ascii_strtoull (cache_time, NULL, 10);
+    }
+    g_free (cache_time);
+  }
+
   return data;
 }
 
@@ -1946,6 +2328,266 @@ xml_spec_get_format (xmlNodePtr xml_node)
   return format;
 }
 
+/* Paths that do not need to be expanded are compiled only once */
+static void
+media_template_compile_path (ExpandableString *path,
+                             MediaTemplate *template)
+{
+  GError *error = NULL;
+  JsonQuery *json_query;
+  gchar *value;
+  xmlXPathCompExprPtr xpath;
+
+  if (!path ||
+      expandable_string_get_dependencies (path) != 0 ||
+      g_hash_table_lookup (template->paths, path)) {
+    return;
+  }
+
+  value = expandable_string_get_value (path, NULL);
+  if (!value) {
+    return;
+  }
+
+  if (template->format == FORMAT_XML) {
+    xpath = xmlXPathCompile ((const xmlChar *) value);
+    if (xpath) {
+      g_hash_table_insert (template->paths, path, xpath);
+    } else {
+      GRL_DEBUG ("XPath '%s' is invalid", value);
+    }
+  } else {
+    json_query = json_query_new (value, &error);
+    if (json_query) {
+      g_hash_table_insert (template->paths, path, json_query);
+    } else {
+      GRL_DEBUG ("JSONPath '%s' is invalid: %s", value, error->message);
+      g_error_free (error);
+    }
+  }
+  expandable_string_free_value (path, value);
+}
+
+static void
+media_template_compile_paths (MediaTemplate *template)
+{
+  FetchData *data;
+  GHashTableIter iter;
+  GList *prdata_list;
+
+  template->paths =
+    g_hash_table_new_full (g_direct_hash,
+                           g_direct_equal,
+                           NULL,
+                           template->format == FORMAT_XML?
+                           (GDestroyNotify) xmlXPathFreeCompExpr:
+                           (GDestroyNotify) json_query_free);
+
+  media_template_compile_path (template->query, template);
+  media_template_compile_path (template->select, template);
+
+  for (prdata_list = template->private_keys;
+       prdata_list;
+       prdata_list = g_list_next (prdata_list)) {
+    media_template_compile_path (((PrivateData *) prdata_list->data)->data,
+                                 template);
+  }
+
+  g_hash_table_iter_init (&iter, template->keys);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &data)) {
+    fetch_data_foreach_raw (data,
+                            (FetchRawFunc) media_template_compile_path,
+                            template);
+  }
+}
+
+/* Checks if @xpath just selects a child element or an attribute of the
+   context node, like "title", "./media:content" or "@url", filling @direct */
+static gboolean
+xml_xpath_is_direct (xmlXPathContextPtr xml_ctx,
+                     const gchar *xpath,
+                     DirectKey *direct)
+{
+  const gchar *c;
+  const gchar *colon = NULL;
+  const xmlChar *href;
+  xmlChar *prefix;
+
+  if (g_str_has_prefix (xpath, "./")) {
+    xpath += 2;
+  }
+
+  if (xpath[0] == '@') {
+    direct->attribute = TRUE;
+    xpath++;
+  }
+
+  for (c = xpath; *c; c++) {
+    if (c == xpath || c == colon + 1) {
+      if (!g_ascii_isalpha (*c) && *c != '_') {
+        return FALSE;
+      }
+    } else if (*c == ':' && !colon) {
+      colon = c;
+    } else if (!g_ascii_isalnum (*c) && *c != '_' && *c != '-' && *c != '.') {
+      return FALSE;
+    }
+  }
+
+  if (c == xpath || (colon && colon[1] == '\0')) {
+    return FALSE;
+  }
+
+  if (colon) {
+    prefix = xmlStrndup ((const xmlChar *) xpath, colon - xpath);
+    href = xmlXPathNsLookup (xml_ctx, prefix);
+    xmlFree (prefix);
+    if (!href) {
+      return FALSE;
+    }
+    direct->href = xmlStrdup (href);
+    direct->name = xmlCharStrdup (colon + 1);
+  } else {
+    direct->name = xmlCharStrdup (xpath);
+  }
+
+  return TRUE;
+}
+
+/* Finds the keys that can be read directly from the items, so all of them are
+   obtained in a single pass instead of fetching them one by one */
+static void
+media_template_find_direct_keys (MediaTemplate *template)
+{
+  DirectKey *direct;
+  FetchData *data;
+  GHashTableIter iter;
+  gchar *xpath;
+  gpointer compiled;
+  gpointer key;
+
+  g_hash_table_iter_init (&iter, template->keys);
+  while (g_hash_table_iter_next (&iter, &key, (gpointer *) &data)) {
+    if (data->type != FETCH_RAW) {
+      continue;
+    }
+
+    /* Only paths that do not need to be expanded */
+    compiled = g_hash_table_lookup (template->paths, data->data.raw);
+    if (!compiled) {
+      continue;
+    }
+
+    direct = g_slice_new0 (DirectKey);
+    direct->key = GRLPOINTER_TO_KEYID (key);
+    if (template->format == FORMAT_XML) {
+      xpath = expandable_string_get_value (data->data.raw, NULL);
+      if (!xml_xpath_is_direct (template->xml_ctx, xpath, direct)) {
+        direct_key_free (direct);
+        direct = NULL;
+      }
+      expandable_string_free_value (data->data.raw, xpath);
+    } else if (json_query_is_simple ((JsonQuery *) compiled)) {
+      direct->json_query = (JsonQuery *) compiled;
+    } else {
+      direct_key_free (direct);
+      direct = NULL;
+    }
+
+    if (direct) {
+      if (!template->direct_keys) {
+        template->direct_keys =
+          g_hash_table_new_full (g_direct_hash,
+                                 g_direct_equal,
+                                 NULL,
+                                 (GDestroyNotify) direct_key_free);
+      }
+      g_hash_table_insert (template->direct_keys, key, direct);
+    }
+  }
+}
+
+/* Buckets the templates by format and operation id. Templates without "ref"
+   are generic: they are candidates for every operation, so they are merged,
+   keeping the spec order, into the list of each referenced operation */
+static void
+media_templates_build_index (GrlXmlFactorySource *source)
+{
+  GList *candidates;
+  GList *pt;
+  GList *ref;
+  GList *refs;
+  MediaTemplate *other;
+  MediaTemplate *template;
+  gint format;
+
+  for (format = 0; format < FORMAT_LAST; format++) {
+    refs = NULL;
+    for (pt = source->priv->media_templates; pt; pt = g_list_next (pt)) {
+      template = (MediaTemplate *) pt->data;
+      if (template->format != format) {
+        continue;
+      }
+      if (!template->operation_id) {
+        source->priv->generic_templates[format] =
+          g_list_prepend (source->priv->generic_templates[format], template);
+      } else if (!g_list_find_custom (refs,
+                                      template->operation_id,
+                                      (GCompareFunc) g_strcmp0)) {
+        refs = g_list_prepend (refs, template->operation_id);
+      }
+    }
+    source->priv->generic_templates[format] =
+      g_list_reverse (source->priv->generic_templates[format]);
+
+    if (!refs) {
+      continue;
+    }
+
+    source->priv->operation_templates[format] =
+      g_hash_table_new_full (g_str_hash,
+                             g_str_equal,
+                             NULL,
+                             (GDestroyNotify) g_list_free);
+    for (ref = refs; ref; ref = g_list_next (ref)) {
+      candidates = NULL;
+      for (pt = source->priv->media_templates; pt; pt = g_list_next (pt)) {
+        other = (MediaTemplate *) pt->data;
+        if (other->format == format &&
+            (!other->operation_id ||
+             g_strcmp0 (other->operation_id, ref->data) == 0)) {
+          candidates = g_list_prepend (candidates, other);
+        }
+      }
+      g_hash_table_insert (source->priv->operation_templates[format],
+                           ref->data,
+                           g_list_reverse (candidates));
+    }
+    g_list_free (refs);
+  }
+}
+
+/* Returns the templates that can be used to build the results of the
+   operation in the given format */
+static GList *
+media_templates_get_candidates (GrlXmlFactorySource *source,
+                                gint format,
+                                Operation *operation)
+{
+  GList *candidates;
+
+  if (operation->id && source->priv->operation_templates[format]) {
+    candidates =
+      g_hash_table_lookup (source->priv->operation_templates[format],
+                           operation->id);
+    if (candidates) {
+      return candidates;
+    }
+  }
+
+  return source->priv->generic_templates[format];
+}
+
 static MediaTemplate *
 xml_spec_get_provide_media_template (GrlXmlFactorySource *source,
                                      xmlNodePtr xml_node,
@@ -1963,7 +2605,6 @@ xml_spec_get_provide_media_template (GrlXmlFactorySource *source,
   gchar *raw;
   gchar *select;
   gchar *source_id;
-  int i;
   xmlChar *use_value;
   xmlNodePtr xml_key;
   xmlNs *ns;
@@ -1973,23 +2614,19 @@ xml_spec_get_provide_media_template (GrlXmlFactorySource *source,
 
   template->line_number = xmlGetLineNo (xml_node);
 
-  if (xml_node->nsDef) {
-    /* Save the NS, as we will free this XML doc */
-    for (ns = xml_node->nsDef, i = 0; ns; ns = ns->next, i++);
-    template->namespace = g_new0 (NameSpace, i);
+  template->format = xml_spec_get_format (xml_node);
+
+  /* XPath context used to evaluate all the paths of the template; the
+     namespaces are registered here once, as we will free this XML doc */
+  if (template->format == FORMAT_XML) {
+    template->xml_ctx = xmlXPathNewContext (NULL);
     for (ns = xml_node->nsDef; ns; ns = ns->next) {
       if (STR_HAS_VALUE (ns->prefix)) {
-        template->namespace[template->namespace_size].prefix =
-          xmlCharStrdup ((const char *) ns->prefix);
-        template->namespace[template->namespace_size].href =
-          xmlCharStrdup ((const char *) ns->href);
-        template->namespace_size++;
+        xmlXPathRegisterNs (template->xml_ctx, ns->prefix, ns->href);
       }
     }
   }
 
-  template->format = xml_spec_get_format (xml_node);
-
   template->operation_id = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "ref");
 
   query = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "query");
@@ -2107,6 +2744,9 @@ xml_spec_get_provide_media_template (GrlXmlFactorySource *source,
     }
   }
 
+  media_template_compile_paths (template);
+  media_template_find_direct_keys (template);
+
   return template;
 }
 
@@ -2230,7 +2870,11 @@ xml_spec_get_operation_result (GrlXmlFactorySource *source,
 {
   ResultData *result_data;
   gchar *result_id;
+  guint cache_time = 0;
+  guint negative_cache_time = 0;
   xmlChar *cache_time_str;
+  xmlChar *negative_cache_time_str;
+  xmlChar *stale_time_str;
 
   result_id = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "ref");
   if (result_id) {
@@ -2251,15 +2895,36 @@ xml_spec_get_operation_result (GrlXmlFactorySource *source,
   result_data->format = xml_spec_get_format (xml_node);
   cache_time_str = xmlGetProp (xml_node, (const xmlChar *) "cache");
   if (STR_HAS_VALUE (cache_time_str)) {
-    result_data->cache_time = (guint) g_ascii_strtoull ((const gchar *) cache_time_str, NULL, 10);
+    cache_time = (guint) g_ascii_strtoull ((const gchar *) cache_time_str, NULL, 10);
   }
   xmlFree (cache_time_str);
+  stale_time_str = xmlGetProp (xml_node, (const xmlChar *) "stale");
+  if (STR_HAS_VALUE (stale_time_str)) {
+    result_data->stale_time = (guint) g_ascii_strtoull ((const gchar *) stale_time_str, NULL, 10);
+  }
+  xmlFree (stale_time_str);
+  negative_cache_time_str = xmlGetProp (xml_node, (const xmlChar *) "negative-cache");
+  if (STR_HAS_VALUE (negative_cache_time_str)) {
+    negative_cache_time = (guint) g_ascii_strtoull ((const gchar *) negative_cache_time_str, NULL, 10);
+  }
+  xmlFree (negative_cache_time_str);
 
   result_data->query = xml_spec_get_fetch_data (source, xml_get_node (xml_node->children));
   if (!result_data->query) {
     result_data_unref (result_data);
     return NULL;
   }
+
+  /* Responses and parsed results are cached by the expanded request, so they
+     are not mixed among different invocations. Failures are cached only for
+     a short time, so a broken service is not queried again and again */
+  if (cache_time > 0 || negative_cache_time > 0) {
+    result_data->cache_time = cache_time;
+    result_data->negative_cache_time = negative_cache_time;
+    fetch_data_set_cache_time (result_data->query,
+                               cache_time,
+                               negative_cache_time);
+  }
   /* Check if result must be saved for further use */
   result_id = (gchar *) xmlGetProp (xml_node, (const xmlChar *) "id");
   if (result_id) {
@@ -2292,6 +2957,11 @@ xml_spec_get_operation_data (GrlXmlFactorySource *source,
 
   xml_spec_get_resolve_properties (xml_node, operation);
 
+  /* Results are sent in order unless told otherwise */
+  operation->unordered =
+    xmlHasProp (xml_node, (const xmlChar *) "ordered") &&
+    !xml_get_property_boolean (xml_node, (const xmlChar *) "ordered");
+
   xml_node = xml_get_node (xml_node->children);
 
   xml_spec_get_operation_requirements (&xml_node, operation);
@@ -2373,8 +3043,7 @@ fetch_data_obtained (const gchar *content,
     insert_value (data->op_data->source, data->item->media, data->key, content);
   }
 
-  data->item->pending_count--;
-  operation_call_send_list_run (data->op_data);
+  operation_call_send_item_done (data->op_data, data->item);
   fetch_item_data_free (data);
 }
 
@@ -2428,21 +3097,153 @@ expandable_string_to_number (ExpandableString *exp_str,
   return default_value;
 }
 
+/* Returns the value of the XML @node */
+static gchar *
+get_value_from_xml_node (xmlDocPtr xml_doc,
+                         xmlNodePtr node)
+{
+  return (gchar *) xmlNodeListGetString (xml_doc, node->xmlChildrenNode, 1);
+}
+
+/* Returns the value of the JSON @node, if it is a string or a number */
+static gchar *
+get_value_from_json_node (JsonNode *node)
+{
+  GValue value = { 0 };
+  gchar *json_value = NULL;
+
+  if (JSON_NODE_HOLDS_VALUE (node)) {
+    json_node_get_value (node, &value);
+    if (G_VALUE_HOLDS_STRING (&value)) {
+      json_value = g_value_dup_string (&value);
+    } else if (G_VALUE_HOLDS_INT64 (&value)) {
+      json_value = g_strdup_printf ("%li", (long int) g_value_get_int64 (&value));
+    } else if (G_VALUE_HOLDS_DOUBLE (&value)) {
+      json_value = g_strdup_printf ("%f", g_value_get_double (&value));
+    }
+    g_value_unset (&value);
+  }
+
+  return json_value;
+}
+
+/* Returns the compiled XPath of @path, whose value is @xpath. It is owned by
+   the template (@paths) or the source, and must not be freed */
+static xmlXPathCompExprPtr
+xpath_get_compiled (GrlXmlFactorySource *source,
+                    GHashTable *paths,
+                    ExpandableString *path,
+                    const gchar *xpath)
+{
+  xmlXPathCompExprPtr compiled;
+
+  if (paths) {
+    compiled = g_hash_table_lookup (paths, path);
+    if (compiled) {
+      return compiled;
+    }
+  }
+
+  if (!source->priv->xpath_cache) {
+    source->priv->xpath_cache = lru_cache_new (XPATH_CACHE_SIZE,
+                                               g_str_hash,
+                                               g_str_equal,
+                                               g_free,
+                                               (GDestroyNotify) xmlXPathFreeCompExpr);
+  }
+
+  compiled = lru_cache_lookup (source->priv->xpath_cache, xpath);
+  if (!compiled) {
+    compiled = xmlXPathCompile ((const xmlChar *) xpath);
+    if (!compiled) {
+      return NULL;
+    }
+    lru_cache_insert (source->priv->xpath_cache, g_strdup (xpath), compiled);
+  }
+
+  return compiled;
+}
+
+/* Evaluates the value of @path, which is @xpath, in @xml_ctx */
+static xmlXPathObjectPtr
+xpath_eval (GrlXmlFactorySource *source,
+            GHashTable *paths,
+            ExpandableString *path,
+            const gchar *xpath,
+            xmlXPathContextPtr xml_ctx)
+{
+  xmlXPathCompExprPtr compiled;
+
+  if (!xpath) {
+    return NULL;
+  }
+
+  compiled = xpath_get_compiled (source, paths, path, xpath);
+  if (!compiled) {
+    return NULL;
+  }
+
+  return xmlXPathCompiledEval (compiled, xml_ctx);
+}
+
+/* Returns the compiled JSONPath of @path, whose value is @json_path. It is
+   owned by the template (@paths) or the source, and must not be freed */
+static JsonQuery *
+json_get_compiled (GrlXmlFactorySource *source,
+                   GHashTable *paths,
+                   ExpandableString *path,
+                   const gchar *json_path,
+                   GError **error)
+{
+  JsonQuery *compiled;
+
+  if (!json_path) {
+    return NULL;
+  }
+
+  if (paths) {
+    compiled = g_hash_table_lookup (paths, path);
+    if (compiled) {
+      return compiled;
+    }
+  }
+
+  if (!source->priv->json_path_cache) {
+    source->priv->json_path_cache = lru_cache_new (JSON_PATH_CACHE_SIZE,
+                                                   g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   (GDestroyNotify) json_query_free);
+  }
+
+  compiled = lru_cache_lookup (source->priv->json_path_cache, json_path);
+  if (!compiled) {
+    compiled = json_query_new (json_path, error);
+    if (!compiled) {
+      return NULL;
+    }
+    lru_cache_insert (source->priv->json_path_cache,
+                      g_strdup (json_path),
+                      compiled);
+  }
+
+  return compiled;
+}
+
 static gchar *
 get_raw_from_path (GrlXmlFactorySource *source,
                    ExpandableString *raw,
                    DataRef *data)
 {
   GError *error = NULL;
-  GValue value = { 0 };
   GetRawData *raw_data;
-  JsonArray *json_array;
+  JsonItems *json_items;
   JsonNode *json_first_node;
   JsonNode *json_node;
+  JsonQuery *json_query;
   gchar *expanded_raw;
-  gchar *json_value = NULL;
+  gchar *json_value;
   gchar *xpath_strvalue;
-  int i;
   xmlDocPtr xml_doc;
   xmlXPathContextPtr xml_ctx;
   xmlXPathObjectPtr xpath;
@@ -2457,17 +3258,16 @@ get_raw_from_path (GrlXmlFactorySource *source,
 
   if (raw_data->xml_doc_reffed) {
     xml_doc = dataref_value (raw_data->xml_doc_reffed);
-    xml_ctx = dataref_value (raw_data->xml_ctx_reffed);
+    xml_ctx = raw_data->xml_ctx;
     xpath = dataref_value (raw_data->xpath_reffed);
+    xml_ctx->doc = xml_doc;
     xml_ctx->node = xpath->nodesetval->nodeTab[raw_data->node];
-    xmlXPathRegisteredNsCleanup (xml_ctx);
-    if (raw_data->namespace) {
-      for (i = 0; i < raw_data->namespace_size; i++) {
-        xmlXPathRegisterNs(xml_ctx, raw_data->namespace[i].prefix, raw_data->namespace[i].href);
-      }
-    }
 
-    xpath_value = xmlXPathEvalExpression ((const xmlChar *) expanded_raw, xml_ctx);
+    xpath_value = xpath_eval (source,
+                              raw_data->paths,
+                              raw,
+                              expanded_raw,
+                              xml_ctx);
     if (!xpath_value) {
       GRL_DEBUG ("XPath '%s' did not return any result", expanded_raw);
       expandable_string_free_value (raw, expanded_raw);
@@ -2478,8 +3278,8 @@ get_raw_from_path (GrlXmlFactorySource *source,
     if (xpath_value->type == XPATH_NODESET &&
         xpath_value->nodesetval &&
         xpath_value->nodesetval->nodeTab) {
-      xpath_strvalue = (gchar *) xmlNodeListGetString (xml_doc,
-                                                       xpath_value->nodesetval->nodeTab[0]->xmlChildrenNode, 1);
+      xpath_strvalue = get_value_from_xml_node (xml_doc,
+                                                xpath_value->nodesetval->nodeTab[0]);
       xmlXPathFreeObject (xpath_value);
       return xpath_strvalue;
     }
@@ -2494,13 +3294,14 @@ get_raw_from_path (GrlXmlFactorySource *source,
   }
 
 
-  if (raw_data->json_array) {
-    json_node = json_path_query (expanded_raw,
-                                 json_array_get_element (raw_data->json_array,
-                                                         raw_data->node),
-                                 &error);
-
-    if (!json_node) {
+  if (raw_data->json_items_reffed) {
+    json_items = dataref_value (raw_data->json_items_reffed);
+    json_query = json_get_compiled (source,
+                                    raw_data->paths,
+                                    raw,
+                                    expanded_raw,
+                                    &error);
+    if (!json_query) {
       if (error) {
         GRL_DEBUG ("JSONPath '%s' error: %s", expanded_raw, error->message);
         g_error_free (error);
@@ -2512,29 +3313,25 @@ get_raw_from_path (GrlXmlFactorySource *source,
       return NULL;
     }
 
-    json_array = json_node_get_array (json_node);
-
-    if (json_array_get_length (json_array) == 0) {
+    json_first_node =
+      json_query_match_first (json_query,
+                              g_ptr_array_index (json_items->nodes,
+                                                 raw_data->node),
+                              &json_node);
+    if (!json_first_node) {
       GRL_DEBUG ("JSONPath '%s' did not return any result", expanded_raw);
       expandable_string_free_value (raw, expanded_raw);
-      json_node_free (json_node);
+      if (json_node) {
+        json_node_free (json_node);
+      }
       return NULL;
     }
 
     expandable_string_free_value (raw, expanded_raw);
-    json_first_node = json_array_get_element (json_array, 0);
-    if (JSON_NODE_HOLDS_VALUE (json_first_node)) {
-      json_node_get_value (json_first_node, &value);
-      if (G_VALUE_HOLDS_STRING (&value)) {
-        json_value = g_value_dup_string (&value);
-      } else if (G_VALUE_HOLDS_INT64 (&value)) {
-        json_value = g_strdup_printf ("%li", (long int) g_value_get_int64 (&value));
-      } else if (G_VALUE_HOLDS_DOUBLE (&value)) {
-        json_value = g_strdup_printf ("%f", g_value_get_double (&value));
-      }
-      g_value_unset (&value);
+    json_value = get_value_from_json_node (json_first_node);
+    if (json_node) {
+      json_node_free (json_node);
     }
-    json_node_free (json_node);
 
     return json_value;
   }
@@ -2548,10 +3345,16 @@ get_raw_from_operation (GrlXmlFactorySource *source,
                         DataRef *data)
 {
   ExpandData *expand_data;
+  gchar *raw_value;
+  gchar *value;
 
   expand_data = dataref_value (data);
 
-  return expandable_string_get_value (raw, expand_data);
+  raw_value = expandable_string_get_value (raw, expand_data);
+  value = g_strdup (raw_value);
+  expandable_string_free_value (raw, raw_value);
+
+  return value;
 }
 
 static GrlMedia *
@@ -2560,46 +3363,24 @@ merge_medias (GrlMedia *original_media,
 {
   GHashTable *new_private_keys;
   GHashTable *old_private_keys;
+  GHashTable *private_keys = NULL;
   GList *k;
   GList *keys;
-  gchar *new_private_keys_string;
 
   if (new_media) {
     /* Merge private keys */
-
-    new_private_keys =
-      json_ghashtable_deserialize_data (grl_data_get_string (GRL_DATA (new_media),
-                                                             GRL_METADATA_KEY_PRIVATE_KEYS),
-                                        -1,
-                                        NULL);
-    old_private_keys =
-      json_ghashtable_deserialize_data (grl_data_get_string (GRL_DATA (original_media),
-                                                             GRL_METADATA_KEY_PRIVATE_KEYS),
-                                        -1,
-                                        NULL);
-    if (new_private_keys) {
-      if (old_private_keys) {
-        merge_hashtables (new_private_keys, old_private_keys);
-        new_private_keys_string = json_ghashtable_serialize_data (new_private_keys, NULL);
-        g_hash_table_unref (old_private_keys);
-      } else {
-        new_private_keys_string = NULL;
+    new_private_keys = private_keys_get (new_media);
+    old_private_keys = private_keys_get (original_media);
+    if (new_private_keys || old_private_keys) {
+      private_keys = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            g_free,
+                                            g_free);
+      if (new_private_keys) {
+        merge_hashtables (private_keys, new_private_keys);
       }
-      g_hash_table_unref (new_private_keys);
-      if (new_private_keys_string) {
-        grl_data_set_string (GRL_DATA (new_media),
-                             GRL_METADATA_KEY_PRIVATE_KEYS,
-                             new_private_keys_string);
-        g_free (new_private_keys_string);
-      }
-    } else {
       if (old_private_keys) {
-        new_private_keys_string = json_ghashtable_serialize_data (old_private_keys, NULL);
-        grl_data_set_string (GRL_DATA (new_media),
-                             GRL_METADATA_KEY_PRIVATE_KEYS,
-                             new_private_keys_string);
-        g_free (new_private_keys_string);
-        g_hash_table_unref (old_private_keys);
+        merge_hashtables (private_keys, old_private_keys);
       }
     }
 
@@ -2613,24 +3394,39 @@ merge_medias (GrlMedia *original_media,
                                   GRLPOINTER_TO_KEYID (k->data)));
     }
     g_list_free (keys);
+
+    if (private_keys) {
+      private_keys_set (original_media, private_keys);
+    }
   }
 
   return original_media;
 }
 
+static void operation_call_resolve_item (OperationCallData *data,
+                                         SendItem *send_item);
+
 static void
 use_resolve_done_cb (GrlMedia *media,
                      gint remaining,
-                     OperationCallData *data,
+                     FetchItemData *data,
                      GError *error)
 {
-  SendItem *send_item = (SendItem *) data->send_list->data;
-  send_item->pending_count--;
+  OperationCallData *op_data = data->op_data;
 
   /* We need to update the media sent by user; so let's merge both medias */
-  merge_medias(send_item->media, media);
+  merge_medias(data->item->media, media);
+
+  /* Start the next resolve waiting, if any. The operation can not finish
+     before as this item has not been sent yet */
+  op_data->resolving--;
+  if (!g_queue_is_empty (&op_data->resolve_queue)) {
+    operation_call_resolve_item (op_data,
+                                 g_queue_pop_head (&op_data->resolve_queue));
+  }
 
-  operation_call_send_list_run (data);
+  operation_call_send_item_done (op_data, data->item);
+  fetch_item_data_free (data);
 }
 
 static gboolean
@@ -2651,42 +3447,32 @@ operation_call_was_cancelled (OperationCallData *data)
   }
 }
 
+/* Sends @send_item, which has no pending keys */
+static void
+operation_call_send_item (OperationCallData *data,
+                          SendItem *send_item)
+{
+  data->callback (send_item->media,
+                  --(data->total_results),
+                  data->user_data,
+                  NULL);
+  send_item_free (send_item);
+}
+
 static void
 operation_call_send_list_run (OperationCallData *data)
 {
-  OperationCallData *resolve_data;
   SendItem *send_item;
 
   /* Start to send all elements when there are no pending operations over each
      element */
-  while (data->send_list) {
-    send_item = (SendItem *) data->send_list->data;
-    if (send_item->pending_count == 0) {
-      /* Check if elements must go through resolve() before sending */
-      if (send_item->apply_resolve) {
-        send_item->apply_resolve = FALSE;
-        send_item->pending_count++;
-        resolve_data = get_resolve_data (data->source,
-                                         data->cancellable,
-                                         send_item->media,
-                                         data->keys,
-                                         data->options,
-                                         (SendResultCb) use_resolve_done_cb,
-                                         data);
-        if (resolve_data) {
-          operation_call (resolve_data);
-          return;
-        }
-      }
-      data->callback (send_item->media,
-                      --(data->total_results),
-                      data->user_data,
-                      NULL);
-      send_item_free (send_item);
-      data->send_list = g_list_delete_link (data->send_list, data->send_list);
-    } else {
+  while (data->send_queue && data->send_head < data->send_queue->len) {
+    send_item = g_ptr_array_index (data->send_queue, data->send_head);
+    if (send_item->pending_count != 0) {
       return;
     }
+    operation_call_send_item (data, send_item);
+    g_ptr_array_index (data->send_queue, data->send_head++) = NULL;
   }
 
   if (data->total_results == 0) {
@@ -2694,12 +3480,205 @@ operation_call_send_list_run (OperationCallData *data)
   }
 }
 
+/* Resolves @send_item to get its use="resolve" keys. Items of the page are
+   resolved at the same time, up to the source maximum; the rest wait for
+   their turn. The item is ready again when resolve() ends */
+static void
+operation_call_resolve_item (OperationCallData *data,
+                             SendItem *send_item)
+{
+  FetchItemData *resolve_item;
+  OperationCallData *resolve_data;
+
+  if (data->resolving >= data->source->priv->max_resolves) {
+    g_queue_push_tail (&data->resolve_queue, send_item);
+    return;
+  }
+
+  resolve_item = fetch_item_data_new ();
+  resolve_item->op_data = data;
+  resolve_item->item = send_item;
+  resolve_item->key = GRL_METADATA_KEY_INVALID;
+  /* The resolve data owns a reference to the cancellable */
+  resolve_data = get_resolve_data (data->source,
+                                   g_object_ref (data->cancellable),
+                                   send_item->media,
+                                   data->keys,
+                                   data->options,
+                                   (SendResultCb) use_resolve_done_cb,
+                                   resolve_item);
+  if (resolve_data) {
+    data->resolving++;
+    operation_call (resolve_data);
+  } else {
+    /* Nothing can resolve it; send it as it is */
+    g_object_unref (data->cancellable);
+    fetch_item_data_free (resolve_item);
+    operation_call_send_item_done (data, send_item);
+  }
+}
+
+/* Items are sent in order, so the queue only needs to be run when the first
+   item waiting to be sent has no pending keys. Operations that do not keep
+   the order send each item as soon as it is ready */
+static void
+operation_call_send_item_ready (OperationCallData *data,
+                                SendItem *send_item)
+{
+  if (send_item->pending_count != 0) {
+    return;
+  }
+
+  /* Check if elements must go through resolve() before sending */
+  if (send_item->apply_resolve) {
+    send_item->apply_resolve = FALSE;
+    send_item->pending_count++;
+    operation_call_resolve_item (data, send_item);
+    return;
+  }
+
+  if (data->operation->unordered) {
+    operation_call_send_item (data, send_item);
+    if (data->total_results == 0) {
+      operation_call_data_free (data);
+    }
+  } else if (g_ptr_array_index (data->send_queue, data->send_head) == send_item) {
+    operation_call_send_list_run (data);
+  }
+}
+
+/* One of the pending keys of @send_item has been solved */
+static void
+operation_call_send_item_done (OperationCallData *data,
+                               SendItem *send_item)
+{
+  send_item->pending_count--;
+  operation_call_send_item_ready (data, send_item);
+}
+
+/* %TRUE if the XML @node is the one selected by @direct */
+static gboolean
+direct_key_match_xml (DirectKey *direct,
+                      xmlNodePtr node)
+{
+  if (xmlStrcmp (node->name, direct->name) != 0) {
+    return FALSE;
+  }
+
+  if (direct->href) {
+    return node->ns && xmlStrcmp (node->ns->href, direct->href) == 0;
+  } else {
+    return node->ns == NULL;
+  }
+}
+
+/* Inserts in the media of @send_item the value of all the @keys that can be
+   read directly from the item, either the XML @xml_item or the JSON
+   @json_item, except those in @skip_keys. Returns the remaining keys */
+static GList *
+send_item_add_direct_keys (GrlXmlFactorySource *source,
+                           MediaTemplate *template,
+                           SendItem *send_item,
+                           GList *keys,
+                           GList *skip_keys,
+                           xmlDocPtr xml_doc,
+                           xmlNodePtr xml_item,
+                           JsonNode *json_item)
+{
+  DirectKey *direct;
+  GList *k;
+  GList *next;
+  GPtrArray *direct_keys;
+  JsonNode *json_node;
+  JsonNode *matches;
+  gchar **values;
+  guint i;
+  xmlAttrPtr xml_attr;
+  xmlNodePtr xml_node;
+
+  if (!template->direct_keys ||
+      (xml_item && xml_item->type != XML_ELEMENT_NODE)) {
+    return keys;
+  }
+
+  direct_keys = g_ptr_array_new ();
+  for (k = keys; k; k = next) {
+    next = g_list_next (k);
+    direct = g_hash_table_lookup (template->direct_keys, k->data);
+    if (direct && !g_list_find (skip_keys, k->data)) {
+      g_ptr_array_add (direct_keys, direct);
+      keys = g_list_delete_link (keys, k);
+    }
+  }
+
+  if (direct_keys->len == 0) {
+    g_ptr_array_free (direct_keys, TRUE);
+    return keys;
+  }
+
+  values = g_new0 (gchar *, direct_keys->len);
+
+  if (xml_item) {
+    /* Scan the item only once; first matching node is used */
+    for (xml_node = xml_item->children; xml_node; xml_node = xml_node->next) {
+      if (xml_node->type != XML_ELEMENT_NODE) {
+        continue;
+      }
+      for (i = 0; i < direct_keys->len; i++) {
+        direct = g_ptr_array_index (direct_keys, i);
+        if (!values[i] &&
+            !direct->attribute &&
+            direct_key_match_xml (direct, xml_node)) {
+          values[i] = get_value_from_xml_node (xml_doc, xml_node);
+        }
+      }
+    }
+    for (xml_attr = xml_item->properties; xml_attr; xml_attr = xml_attr->next) {
+      for (i = 0; i < direct_keys->len; i++) {
+        direct = g_ptr_array_index (direct_keys, i);
+        if (!values[i] &&
+            direct->attribute &&
+            direct_key_match_xml (direct, (xmlNodePtr) xml_attr)) {
+          values[i] = get_value_from_xml_node (xml_doc, (xmlNodePtr) xml_attr);
+        }
+      }
+    }
+  } else {
+    for (i = 0; i < direct_keys->len; i++) {
+      direct = g_ptr_array_index (direct_keys, i);
+      json_node = json_query_match_first (direct->json_query,
+                                          json_item,
+                                          &matches);
+      if (json_node) {
+        values[i] = get_value_from_json_node (json_node);
+      }
+      if (matches) {
+        json_node_free (matches);
+      }
+    }
+  }
+
+  for (i = 0; i < direct_keys->len; i++) {
+    direct = g_ptr_array_index (direct_keys, i);
+    if (values[i]) {
+      insert_value (source, send_item->media, direct->key, values[i]);
+      g_free (values[i]);
+    }
+  }
+
+  send_item->pending_count -= direct_keys->len;
+
+  g_free (values);
+  g_ptr_array_free (direct_keys, TRUE);
+
+  return keys;
+}
+
 static gboolean
 operation_call_send_xml_results (OperationCallData *data)
 {
   DataRef *get_raw_data_reffed;
   DataRef *media_template_xpath_reffed;
-  DataRef *xml_ctx_reffed;
   DataRef *xml_doc_reffed;
   ExpandableString *xpath_query;
   FetchData *fetch_data;
@@ -2716,7 +3695,6 @@ operation_call_send_xml_results (OperationCallData *data)
   MediaTemplate *media_template;
   PrivateData *prdata;
   SendItem *send_item;
-  gchar *json_data;
   gchar *prvalue;
   gchar *xpath;
   gint pending;
@@ -2732,15 +3710,15 @@ operation_call_send_xml_results (OperationCallData *data)
 
   xml_doc_reffed = dataref_ref (data->xml_doc_reffed);
   xml_doc = dataref_value (xml_doc_reffed);
-  xml_ctx = xmlXPathNewContext (xml_doc);
-  xml_ctx_reffed = dataref_new (xml_ctx, (GDestroyNotify) xmlXPathFreeContext);
 
 
   /* Scan all media templates, finding those that match the results */
   GRL_XML_DEBUG_LITERAL (data->source,
                          GRL_XML_DEBUG_PROVIDE,
                          "Selecting XML provide template");
-  for (pt = data->source->priv->media_templates;
+  for (pt = media_templates_get_candidates (data->source,
+                                           FORMAT_XML,
+                                           data->operation);
        pt && data->total_results < (data->skip + data->count);
        pt = g_list_next (pt)) {
     media_template = (MediaTemplate *) pt->data;
@@ -2750,36 +3728,18 @@ operation_call_send_xml_results (OperationCallData *data)
                    "Testing template in line %ld",
                    media_template->line_number);
 
-    if (media_template->format != FORMAT_XML) {
-      GRL_XML_DEBUG_LITERAL (data->source,
-                             GRL_XML_DEBUG_PROVIDE,
-                             "Failed: not a XML template");
-      continue;
-    }
-
-    if (media_template->operation_id &&
-        g_strcmp0 (media_template->operation_id, data->operation->id) != 0) {
-      GRL_XML_DEBUG (data->source,
-                     GRL_XML_DEBUG_PROVIDE,
-                     "Failed: expected operation id '%s', current is '%s'",
-                     media_template->operation_id,
-                     data->operation->id);
-      continue;
-    }
-
-    xmlXPathRegisteredNsCleanup (xml_ctx);
-
-    /* Register the namespaces */
-    if (media_template->namespace) {
-      for (i = 0; i < media_template->namespace_size; i++) {
-        xmlXPathRegisterNs(xml_ctx, media_template->namespace[i].prefix, media_template->namespace[i].href);
-      }
-    }
+    xml_ctx = media_template->xml_ctx;
+    xml_ctx->doc = xml_doc;
+    xml_ctx->node = NULL;
 
     if (data->operation_type == OP_RESOLVE) {
       if (media_template->select) {
         xpath = expandable_string_get_value (media_template->select, data->expand_data);
-        media_template_xpath = xmlXPathEvalExpression ((const xmlChar *) xpath, xml_ctx);
+        media_template_xpath = xpath_eval (data->source,
+                                           media_template->paths,
+                                           media_template->select,
+                                           xpath,
+                                           xml_ctx);
         if (!media_template_xpath) {
           GRL_XML_DEBUG (data->source,
                          GRL_XML_DEBUG_PROVIDE,
@@ -2799,13 +3759,17 @@ operation_call_send_xml_results (OperationCallData *data)
     } else {
       if (media_template->query) {
         xpath = expandable_string_get_value (media_template->query, data->expand_data);
-        media_template_xpath = xmlXPathEvalExpression ((const xmlChar *) xpath, xml_ctx);
+        media_template_xpath = xpath_eval (data->source,
+                                           media_template->paths,
+                                           media_template->query,
+                                           xpath,
+                                           xml_ctx);
         if (!media_template_xpath) {
           GRL_XML_DEBUG (data->source,
                          GRL_XML_DEBUG_PROVIDE,
                          "Failed: XPath '%s' is invalid",
                          xpath);
-          expandable_string_free_value (media_template->select, xpath);
+          expandable_string_free_value (media_template->query, xpath);
           continue;
         }
         xpath_query = media_template->query;
@@ -2865,7 +3829,7 @@ operation_call_send_xml_results (OperationCallData *data)
     operation_call_data_free (data);
     g_list_free (matching_templates);
     g_list_free_full (matching_xpath, (GDestroyNotify) dataref_unref);
-    dataref_unref (xml_ctx_reffed);
+    dataref_unref (xml_doc_reffed);
     return FALSE;
   }
 
@@ -2894,15 +3858,19 @@ operation_call_send_xml_results (OperationCallData *data)
                        gtype_to_string (media_template->media_type));
         send_item->media = g_object_new (media_template->media_type, NULL);
         send_item->pending_count = g_list_length (keys);
-        data->send_list = g_list_append (data->send_list, send_item);
+        if (!data->operation->unordered) {
+          if (!data->send_queue) {
+            data->send_queue = g_ptr_array_sized_new (data->total_results);
+          }
+          g_ptr_array_add (data->send_queue, send_item);
+        }
 
         get_raw_data = get_raw_data_new ();
         get_raw_data->xpath_reffed = dataref_ref (media_template_xpath_reffed);
-        get_raw_data->xml_ctx_reffed = dataref_ref (xml_ctx_reffed);
+        get_raw_data->xml_ctx = media_template->xml_ctx;
         get_raw_data->xml_doc_reffed = dataref_ref (xml_doc_reffed);
         get_raw_data->node = i;
-        get_raw_data->namespace = media_template->namespace;
-        get_raw_data->namespace_size = media_template->namespace_size;
+        get_raw_data->paths = media_template->paths;
         get_raw_data->expand_data = expand_data_ref (data->expand_data);
 
         get_raw_data_reffed = dataref_new (get_raw_data, (GDestroyNotify) get_raw_data_free);
@@ -2926,26 +3894,30 @@ operation_call_send_xml_results (OperationCallData *data)
             g_hash_table_insert (private_keys, g_strdup (prdata->name), prvalue);
           }
 
-          json_data = json_ghashtable_serialize_data (private_keys, NULL);
-          grl_data_set_string (GRL_DATA (send_item->media),
-                               GRL_METADATA_KEY_PRIVATE_KEYS,
-                               json_data);
-          g_hash_table_unref (private_keys);
-          g_free (json_data);
+          private_keys_set (send_item->media, private_keys);
         }
 
+        /* Add the keys read directly from the item */
+        keys = send_item_add_direct_keys (data->source,
+                                          media_template,
+                                          send_item,
+                                          keys,
+                                          NULL,
+                                          xml_doc,
+                                          media_template_xpath->nodesetval->nodeTab[i],
+                                          NULL);
+        operation_call_send_item_ready (data, send_item);
+
         /* Now add the keys */
         for (k = keys; k; k = g_list_next (k)) {
           if (grl_data_has_key (GRL_DATA (send_item->media),
                                 GRLPOINTER_TO_KEYID (k->data))) {
-            send_item->pending_count--;
-            operation_call_send_list_run (data);
+            operation_call_send_item_done (data, send_item);
             continue;
           }
           fetch_data = (FetchData *) g_hash_table_lookup (media_template->keys, k->data);
           if (!fetch_data) {
-            send_item->pending_count--;
-            operation_call_send_list_run (data);
+            operation_call_send_item_done (data, send_item);
             continue;
           }
 
@@ -2977,7 +3949,6 @@ operation_call_send_xml_results (OperationCallData *data)
 
   g_list_free (matching_templates);
   g_list_free_full (matching_xpath, (GDestroyNotify) dataref_unref);
-  dataref_unref (xml_ctx_reffed);
   dataref_unref (xml_doc_reffed);
 
   return FALSE;
@@ -2987,6 +3958,7 @@ static gboolean
 operation_call_send_json_results (OperationCallData *data)
 {
   DataRef *get_raw_data_reffed;
+  DataRef *json_items_reffed;
   ExpandableString *json_query;
   FetchData *fetch_data;
   FetchItemData *fetch_item;
@@ -2999,19 +3971,17 @@ operation_call_send_json_results (OperationCallData *data)
   GList *pt;
   GList *px;
   GetRawData *get_raw_data;
-  JsonArray *json_array;
-  JsonNode *json_found_nodes = NULL;
+  JsonItems *json_items;
   JsonNode *root_node;
+  JsonQuery *compiled_query;
   MediaTemplate *media_template;
   PrivateData *prdata;
   SendItem *send_item;
-  gchar *json_data;
   gchar *json_path;
   gchar *prvalue;
   gint pending;
-  guint json_array_length;
   guint skip;
-  int i;
+  guint i;
 
   if (operation_call_was_cancelled (data)) {
     return FALSE;
@@ -3023,7 +3993,9 @@ operation_call_send_json_results (OperationCallData *data)
   GRL_XML_DEBUG_LITERAL (data->source,
                          GRL_XML_DEBUG_PROVIDE,
                          "Selecting JSON provide template");
-  for (pt = data->source->priv->media_templates;
+  for (pt = media_templates_get_candidates (data->source,
+                                           FORMAT_JSON,
+                                           data->operation);
        pt && data->total_results < (data->skip + data->count);
        pt = g_list_next (pt)) {
     media_template = (MediaTemplate *) pt->data;
@@ -3033,35 +4005,8 @@ operation_call_send_json_results (OperationCallData *data)
                    "Testing template in line %ld",
                    media_template->line_number);
 
-    if (media_template->format != FORMAT_JSON) {
-      GRL_XML_DEBUG_LITERAL (data->source,
-                             GRL_XML_DEBUG_PROVIDE,
-                             "Failed: not a JSON template");
-      continue;
-    }
-
-    if (media_template->operation_id &&
-        g_strcmp0 (media_template->operation_id, data->operation->id) != 0) {
-      GRL_XML_DEBUG (data->source,
-                     GRL_XML_DEBUG_PROVIDE,
-                     "Failed: expected operation id '%s', current is '%s'",
-                     media_template->operation_id,
-                     data->operation->id);
-      continue;
-    }
-
-    json_found_nodes = NULL;
-    json_array = NULL;
     if (data->operation_type == OP_RESOLVE) {
       if (media_template->select) {
-        json_path = expandable_string_get_value (media_template->select, data->expand_data);
-        /* Special case: "$" represents the root node */
-        if (json_path[0] == '$' && json_path[1] == '\0') {
-          json_array = json_array_new ();
-          json_array_add_element (json_array, json_node_copy (root_node));
-        } else {
-          json_found_nodes = json_path_query (json_path, root_node, NULL);
-        }
         json_query = media_template->select;
       } else {
         GRL_XML_DEBUG_LITERAL (data->source,
@@ -3071,14 +4016,6 @@ operation_call_send_json_results (OperationCallData *data)
       }
     } else {
       if (media_template->query) {
-        json_path = expandable_string_get_value (media_template->query, data->expand_data);
-        /* Special case: "$" represents the root node */
-        if (json_path[0] == '$' && json_path[1] == '\0') {
-          json_array = json_array_new ();
-          json_array_add_element (json_array, json_node_copy (root_node));
-        } else {
-          json_found_nodes = json_path_query (json_path, root_node, NULL);
-        }
         json_query = media_template->query;
       } else {
           GRL_XML_DEBUG_LITERAL (data->source,
@@ -3088,7 +4025,13 @@ operation_call_send_json_results (OperationCallData *data)
       }
     }
 
-    if (!json_found_nodes && !json_array) {
+    json_path = expandable_string_get_value (json_query, data->expand_data);
+    compiled_query = json_get_compiled (data->source,
+                                        media_template->paths,
+                                        json_query,
+                                        json_path,
+                                        NULL);
+    if (!compiled_query) {
       GRL_XML_DEBUG (data->source,
                      GRL_XML_DEBUG_PROVIDE,
                      "Failed: JSON '%s' return no values",
@@ -3097,22 +4040,17 @@ operation_call_send_json_results (OperationCallData *data)
       continue;
     }
 
-    if (!json_array) {
-      json_array = json_node_get_array (json_found_nodes);
-    }
-
-    json_array_length = json_array_get_length (json_array);
+    json_items = json_items_new (data->json_parser);
+    json_items->matches = json_query_match (compiled_query,
+                                            root_node,
+                                            json_items->nodes);
 
-    if (json_array_length == 0) {
+    if (json_items->nodes->len == 0) {
       GRL_XML_DEBUG (data->source,
                      GRL_XML_DEBUG_PROVIDE,
                      "Failed: JSON '%s' return no values",
                      json_path);
-      if (json_found_nodes) {
-        json_node_free (json_found_nodes);
-      } else {
-        json_array_unref (json_array);
-      }
+      json_items_free (json_items);
       expandable_string_free_value (json_query, json_path);
       continue;
     }
@@ -3126,18 +4064,13 @@ operation_call_send_json_results (OperationCallData *data)
 
     matching_templates = g_list_prepend (matching_templates, media_template);
     matching_json_path = g_list_prepend (matching_json_path,
-                                         json_array_ref (json_array));
-    data->total_results += json_array_length;
+                                         dataref_new (json_items,
+                                                      (GDestroyNotify) json_items_free));
+    data->total_results += json_items->nodes->len;
     GRL_XML_DEBUG (data->source,
                    GRL_XML_DEBUG_PROVIDE,
-                   "Obtained %d results",
-                   json_array_length);
-
-    if (json_found_nodes) {
-      json_node_free (json_found_nodes);
-    } else {
-      json_array_unref (json_array);
-    }
+                   "Obtained %u results",
+                   json_items->nodes->len);
   }
 
   matching_templates = g_list_reverse (matching_templates);
@@ -3160,7 +4093,7 @@ operation_call_send_json_results (OperationCallData *data)
     data->callback (NULL, 0, data->user_data, NULL);
     operation_call_data_free (data);
     g_list_free (matching_templates);
-    g_list_free_full (matching_json_path, (GDestroyNotify) json_array_unref);
+    g_list_free_full (matching_json_path, (GDestroyNotify) dataref_unref);
     return FALSE;
   }
 
@@ -3178,9 +4111,9 @@ operation_call_send_json_results (OperationCallData *data)
                    data->total_results);
     while (pending > 0) {
       media_template = (MediaTemplate *) pt->data;
-      json_array = (JsonArray *) px->data;
-      json_array_length = json_array_get_length (json_array);
-      for (i = skip; i < json_array_length && pending > 0; i++) {
+      json_items_reffed = (DataRef *) px->data;
+      json_items = (JsonItems *) dataref_value (json_items_reffed);
+      for (i = skip; i < json_items->nodes->len && pending > 0; i++) {
         keys = merge_lists (data->keys, media_template->mandatory_keys);
         send_item = send_item_new ();
         GRL_XML_DEBUG (data->source,
@@ -3189,10 +4122,16 @@ operation_call_send_json_results (OperationCallData *data)
                        gtype_to_string (media_template->media_type));
         send_item->media = g_object_new (media_template->media_type, NULL);
         send_item->pending_count = g_list_length (keys);
-        data->send_list = g_list_append (data->send_list, send_item);
+        if (!data->operation->unordered) {
+          if (!data->send_queue) {
+            data->send_queue = g_ptr_array_sized_new (data->total_results);
+          }
+          g_ptr_array_add (data->send_queue, send_item);
+        }
 
         get_raw_data = get_raw_data_new ();
-        get_raw_data->json_array = json_array_ref (json_array);
+        get_raw_data->json_items_reffed = dataref_ref (json_items_reffed);
+        get_raw_data->paths = media_template->paths;
         get_raw_data->node = i;
         get_raw_data->expand_data = expand_data_ref (data->expand_data);
 
@@ -3202,7 +4141,7 @@ operation_call_send_json_results (OperationCallData *data)
         if (media_template->private_keys) {
           private_keys = g_hash_table_new_full (g_str_hash,
                                                 g_str_equal,
-                                                NULL,
+                                                g_free,
                                                 g_free);
           for (prdata_list = media_template->private_keys;
                prdata_list;
@@ -3214,36 +4153,40 @@ operation_call_send_json_results (OperationCallData *data)
                            "Adding \"%s\" private key: \"%s\"",
                            prdata->name,
                          prvalue);
-            g_hash_table_insert (private_keys, prdata->name, prvalue);
+            g_hash_table_insert (private_keys, g_strdup (prdata->name), prvalue);
           }
 
-          json_data = json_ghashtable_serialize_data (private_keys, NULL);
-          grl_data_set_string (GRL_DATA (send_item->media),
-                               GRL_METADATA_KEY_PRIVATE_KEYS,
-                               json_data);
-          g_hash_table_unref (private_keys);
-          g_free (json_data);
+          private_keys_set (send_item->media, private_keys);
         }
 
+        /* Add the keys read directly from the item */
+        keys = send_item_add_direct_keys (data->source,
+                                          media_template,
+                                          send_item,
+                                          keys,
+                                          data->operation_type != OP_RESOLVE?
+                                          data->source->priv->use_resolve_keys: NULL,
+                                          NULL,
+                                          NULL,
+                                          g_ptr_array_index (json_items->nodes, i));
+        operation_call_send_item_ready (data, send_item);
+
         /* Now add the keys */
         for (k = keys; k; k = g_list_next (k)) {
           if (grl_data_has_key (GRL_DATA (send_item->media),
                                 GRLPOINTER_TO_KEYID (k->data))) {
-            send_item->pending_count--;
-            operation_call_send_list_run (data);
+            operation_call_send_item_done (data, send_item);
             continue;
           }
           if (data->operation_type != OP_RESOLVE &&
               g_list_find (data->source->priv->use_resolve_keys, k->data)) {
             send_item->apply_resolve = TRUE;
-            send_item->pending_count--;
-            operation_call_send_list_run (data);
+            operation_call_send_item_done (data, send_item);
             continue;
           }
           fetch_data = (FetchData *) g_hash_table_lookup (media_template->keys, k->data);
           if (!fetch_data) {
-            send_item->pending_count--;
-            operation_call_send_list_run (data);
+            operation_call_send_item_done (data, send_item);
             continue;
           }
 
@@ -3267,96 +4210,312 @@ operation_call_send_json_results (OperationCallData *data)
         g_list_free (keys);
         pending--;
       }
-      skip -= MIN (skip, json_array_length);
+      skip -= MIN (skip, json_items->nodes->len);
       pt = g_list_next (pt);
       px = g_list_next (px);
     }
   }
 
   g_list_free (matching_templates);
-  g_list_free_full (matching_json_path, (GDestroyNotify) json_array_unref);
+  g_list_free_full (matching_json_path, (GDestroyNotify) dataref_unref);
 
   return FALSE;
 }
 
 static void
-operation_call_data_fetched (const gchar *content,
-                             OperationCallData *data,
-                             const GError *op_error)
+operation_call_send_results (OperationCallData *data)
 {
-  GError *error = NULL;
-  JsonParser *json_parser;
-  gboolean parser_success = FALSE;
-  xmlDocPtr xml_doc = NULL;
+  if (data->operation->result->format == FORMAT_XML) {
+    EXECUTE_CALL (data->options,
+                  operation_call_send_xml_results,
+                  data);
+  } else {
+    EXECUTE_CALL (data->options,
+                  operation_call_send_json_results,
+                  data);
+  }
+}
 
-  if (op_error) {
-    data->callback (NULL, 0, data->user_data, error);
-    operation_call_data_free (data);
+/* Parses @content as a result in @format. Returns %FALSE if it fails */
+static gboolean
+result_parse (gint format,
+              const gchar *content,
+              DataRef **xml_doc_reffed,
+              JsonParser **json_parser)
+{
+  xmlDocPtr xml_doc;
+
+  if (format == FORMAT_XML) {
+    xml_doc = xmlReadMemory (content, xmlStrlen ((const xmlChar *) content), NULL, NULL,
+                             XML_PARSE_RECOVER | XML_PARSE_NOBLANKS);
+    if (!xml_doc) {
+      return FALSE;
+    }
+    *xml_doc_reffed = dataref_new (xml_doc, (GDestroyNotify) xmlFreeDoc);
+  } else {
+    *json_parser = json_parser_new ();
+    if (!json_parser_load_from_data (*json_parser, content, -1, NULL)) {
+      g_clear_object (json_parser);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Like result_parse(), but if @previous was parsed from the same content its
+   document is reused instead. If @checksum is not %NULL, it is set to the
+   checksum of @content */
+static gboolean
+result_get (gint format,
+            const gchar *content,
+            CachedResult *previous,
+            gchar **checksum,
+            DataRef **xml_doc_reffed,
+            JsonParser **json_parser)
+{
+  gchar *content_checksum;
+
+  if (!checksum || !content) {
+    return result_parse (format, content, xml_doc_reffed, json_parser);
+  }
+
+  content_checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, content, -1);
+  if (previous &&
+      previous->checksum &&
+      g_strcmp0 (previous->checksum, content_checksum) == 0) {
+    if (previous->xml_doc_reffed) {
+      *xml_doc_reffed = dataref_ref (previous->xml_doc_reffed);
+    } else {
+      *json_parser = g_object_ref (previous->json_parser);
+    }
+    *checksum = content_checksum;
+    return TRUE;
+  }
+
+  if (!result_parse (format, content, xml_doc_reffed, json_parser)) {
+    g_free (content_checksum);
+    return FALSE;
+  }
+
+  *checksum = content_checksum;
+
+  return TRUE;
+}
+
+/* Caches the parsed result of @source for @key. The cost of the result is
+   the time spent to get it. Once expired, it is kept to be reused if the
+   content has not changed */
+static void
+result_cache_store (GrlXmlFactorySource *source,
+                    ResultData *result,
+                    const gchar *key,
+                    DataRef *xml_doc_reffed,
+                    JsonParser *json_parser,
+                    const gchar *checksum,
+                    gint64 start_time)
+{
+  CachedResult *cached;
+
+  if (!result_cache || result->cache_time == 0) {
     return;
   }
 
-  if (operation_call_was_cancelled (data)) {
+  cached = cached_result_new (xml_doc_reffed, json_parser, checksum);
+  cache_insert_full (result_cache,
+                     key,
+                     cached,
+                     cached_result_get_size (cached),
+                     (gdouble) (g_get_monotonic_time () - start_time),
+                     result->cache_time,
+                     result->stale_time > 0? result->stale_time: RESULT_REVALIDATE_TIME,
+                     source);
+}
+
+/* Remembers for a while that the result of @source for @key can not be
+   parsed */
+static void
+result_cache_store_failure (GrlXmlFactorySource *source,
+                            ResultData *result,
+                            const gchar *key)
+{
+  if (!result_cache || result->negative_cache_time == 0) {
     return;
   }
 
-  if (data->operation->result->format == FORMAT_XML) {
-    xml_doc = xmlReadMemory (content, xmlStrlen ((const xmlChar *) content), NULL, NULL,
-                             XML_PARSE_RECOVER | XML_PARSE_NOBLANKS);
-  } else {
-    json_parser = json_parser_new ();
-    parser_success = json_parser_load_from_data (json_parser, content, -1, NULL);
+  cache_insert_full (result_cache,
+                     key,
+                     cached_result_new (NULL, NULL, NULL),
+                     strlen (key),
+                     0,
+                     result->negative_cache_time,
+                     0,
+                     source);
+}
+
+static void
+operation_call_send_parse_error (OperationCallData *data)
+{
+  GError *error;
+
+  error = g_error_new (GRL_CORE_ERROR, 0, "Unable to read source: can't parse result");
+  GRL_DEBUG ("%s", error->message);
+  data->callback (NULL, 0, data->user_data, error);
+  g_error_free (error);
+  operation_call_data_free (data);
+}
+
+static void
+refresh_data_free (RefreshData *data)
+{
+  if (refreshing_results) {
+    g_hash_table_remove (refreshing_results, data->key);
   }
+  g_object_unref (data->source);
+  result_data_unref (data->result);
+  g_free (data->key);
+  expand_data_unref (data->expand_data);
+  g_object_unref (data->cancellable);
+  g_clear_pointer (&data->previous, (GDestroyNotify) cached_result_free);
+  g_slice_free (RefreshData, data);
+}
 
-  if (!xml_doc && !parser_success) {
-    error = g_error_new (GRL_CORE_ERROR, 0, "Unable to read source: can't parse result");
-    GRL_DEBUG ("%s", error->message);
+static void
+refresh_result_fetched (const gchar *content,
+                        RefreshData *data,
+                        const GError *error)
+{
+  DataRef *xml_doc_reffed = NULL;
+  JsonParser *json_parser = NULL;
+  gchar *checksum = NULL;
+
+  if (!error &&
+      content &&
+      result_get (data->result->format,
+                  content,
+                  data->previous,
+                  &checksum,
+                  &xml_doc_reffed,
+                  &json_parser)) {
+    GRL_XML_DEBUG_LITERAL (data->source,
+                           GRL_XML_DEBUG_OPERATION,
+                           "Refreshed cached result");
+    result_cache_store (data->source,
+                        data->result,
+                        data->key,
+                        xml_doc_reffed,
+                        json_parser,
+                        checksum,
+                        data->start_time);
+    g_clear_pointer (&xml_doc_reffed, (GDestroyNotify) dataref_unref);
+    g_clear_object (&json_parser);
+    g_free (checksum);
+  }
+
+  refresh_data_free (data);
+}
+
+/* Gets again the result of the operation, which is in the cache but has
+   expired, without sending it */
+static void
+operation_call_refresh_result (OperationCallData *data)
+{
+  DataRef *data_reffed;
+  RefreshData *refresh;
+
+  if (!refreshing_results) {
+    refreshing_results = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+
+  /* Already being refreshed */
+  if (g_hash_table_lookup (refreshing_results, data->result_key)) {
+    return;
+  }
+
+  refresh = g_slice_new (RefreshData);
+  refresh->source = g_object_ref (data->source);
+  refresh->result = result_data_ref (data->operation->result);
+  refresh->key = g_strdup (data->result_key);
+  refresh->expand_data = expand_data_ref (data->expand_data);
+  refresh->cancellable = g_cancellable_new ();
+  refresh->previous = data->previous;
+  data->previous = NULL;
+  refresh->start_time = g_get_monotonic_time ();
+  g_hash_table_insert (refreshing_results, refresh->key, refresh);
+
+  data_reffed = dataref_new (expand_data_ref (refresh->expand_data),
+                             (GDestroyNotify) expand_data_unref);
+  fetch_data_get (refresh->source,
+                  GRL_XML_DEBUG_OPERATION,
+                  refresh->source->priv->wc,
+                  refresh->result->query,
+                  refresh->expand_data,
+                  refresh->cancellable,
+                  get_raw_from_operation,
+                  data_reffed,
+                  (DataFetchedCb) refresh_result_fetched,
+                  refresh);
+  dataref_unref (data_reffed);
+}
+
+static void
+operation_call_data_fetched (const gchar *content,
+                             OperationCallData *data,
+                             const GError *op_error)
+{
+  GError *error = NULL;
+  gchar *checksum = NULL;
+
+  /* The error can be shared with other operations, and the callback can
+     change it */
+  if (op_error) {
+    error = g_error_copy (op_error);
     data->callback (NULL, 0, data->user_data, error);
     g_error_free (error);
     operation_call_data_free (data);
     return;
   }
 
-  if (data->operation->result->format == FORMAT_XML) {
-    data->xml_doc_reffed = dataref_new (xml_doc, (GDestroyNotify) xmlFreeDoc);
-  } else {
-    data->json_parser = json_parser;
+  if (operation_call_was_cancelled (data)) {
+    return;
   }
 
-  /* Cache results if proceed */
-  if (data->operation->result->cache_time > 0) {
-    if (!data->operation->result->cache_valid &&
-        data->operation->result->cache.xml) {
-      if (data->operation->result->format == FORMAT_XML) {
-        dataref_unref (data->operation->result->cache.xml);
-      } else {
-        g_object_unref (data->operation->result->cache.json);
-      }
-    }
-    if (data->operation->result->format == FORMAT_XML) {
-      data->operation->result->cache.xml = dataref_ref (data->xml_doc_reffed);
-    } else {
-      data->operation->result->cache.json = g_object_ref (data->json_parser);
+  if (!result_get (data->operation->result->format,
+                   content,
+                   data->previous,
+                   data->result_key? &checksum: NULL,
+                   &data->xml_doc_reffed,
+                   &data->json_parser)) {
+    if (data->result_key) {
+      result_cache_store_failure (data->source,
+                                  data->operation->result,
+                                  data->result_key);
     }
-    data->operation->result->cache_valid = TRUE;
-    g_timeout_add_seconds (data->operation->result->cache_time,
-                           (GSourceFunc) cache_expired_cb,
-                           data->operation->result);
+    operation_call_send_parse_error (data);
+    return;
   }
-  if (data->operation->result->format == FORMAT_XML) {
-    EXECUTE_CALL (data->options,
-                  operation_call_send_xml_results,
-                  data);
-  } else {
-    EXECUTE_CALL (data->options,
-                  operation_call_send_json_results,
-                  data);
+
+  if (data->result_key) {
+    result_cache_store (data->source,
+                        data->operation->result,
+                        data->result_key,
+                        data->xml_doc_reffed,
+                        data->json_parser,
+                        checksum,
+                        data->start_time);
+    g_free (checksum);
   }
+
+  operation_call_send_results (data);
 }
 
 static void
 operation_call (OperationCallData *data)
 {
+  CachedResult *cached;
   DataRef *data_reffed;
+  gboolean stale = FALSE;
+  gchar *query_key;
 
   data->skip = expandable_string_to_number (data->operation->skip,
                                             data->expand_data,
@@ -3368,37 +4527,150 @@ operation_call (OperationCallData *data)
   /* Avoid trying to send more elements than requested */
   data->count = MIN (data->count, grl_operation_options_get_count (data->options));
 
-  if (data->operation->result->cache.xml &&
-      data->operation->result->cache_valid) {
-    GRL_XML_DEBUG_LITERAL (data->source,
-                           GRL_XML_DEBUG_PROVIDE,
-                           "Reusing cached result");
-
-    if (data->operation->result->format == FORMAT_XML) {
-      data->xml_doc_reffed = dataref_ref (data->operation->result->cache.xml);
-      EXECUTE_CALL (data->options,
-                    operation_call_send_xml_results,
-                    data);
-    } else {
-      data->json_parser = g_object_ref (data->operation->result->cache.json);
-      EXECUTE_CALL (data->options,
-                    operation_call_send_json_results,
-                    data);
+  /* Use the parsed result of a previous invocation with the same request */
+  if (data->operation->result->cache_time > 0 ||
+      data->operation->result->negative_cache_time > 0) {
+    query_key = fetch_data_get_key (data->operation->result->query,
+                                    data->expand_data);
+    if (query_key) {
+      data->result_key = g_strconcat (grl_source_get_id (GRL_SOURCE (data->source)),
+                                      "\n",
+                                      query_key,
+                                      NULL);
+      g_free (query_key);
     }
-  } else {
-    data_reffed = dataref_new (expand_data_ref (data->expand_data),
+  }
+  /* An expired result can still be used for a while, if allowed, while it
+     is refreshed. Otherwise it is only reused if the content has not
+     changed */
+  if (data->result_key) {
+    cached = cache_lookup_stale (result_cache, data->result_key, &stale);
+    if (cached && !cached->xml_doc_reffed && !cached->json_parser) {
+      GRL_XML_DEBUG_LITERAL (data->source,
+                             GRL_XML_DEBUG_OPERATION,
+                             "Using cached failure");
+      operation_call_send_parse_error (data);
+      return;
+    }
+    if (cached && stale) {
+      data->previous = cached_result_new (cached->xml_doc_reffed,
+                                          cached->json_parser,
+                                          cached->checksum);
+    }
+    if (cached && (!stale || data->operation->result->stale_time > 0)) {
+      GRL_XML_DEBUG_LITERAL (data->source,
+                             GRL_XML_DEBUG_OPERATION,
+                             stale? "Using stale cached result": "Using cached result");
+      if (cached->xml_doc_reffed) {
+        data->xml_doc_reffed = dataref_ref (cached->xml_doc_reffed);
+      } else {
+        data->json_parser = g_object_ref (cached->json_parser);
+      }
+      if (stale) {
+        operation_call_refresh_result (data);
+      }
+      operation_call_send_results (data);
+      return;
+    }
+  }
+
+  data->start_time = g_get_monotonic_time ();
+  data_reffed = dataref_new (expand_data_ref (data->expand_data),
                              (GDestroyNotify) expand_data_unref);
-    fetch_data_get (data->source,
-                    GRL_XML_DEBUG_OPERATION,
-                    data->source->priv->wc,
-                    data->operation->result->query,
-                    data->expand_data,
-                    data->cancellable,
-                    get_raw_from_operation,
-                    data_reffed,
-                    (DataFetchedCb) operation_call_data_fetched,
-                    data);
-    dataref_unref (data_reffed);
+  fetch_data_get (data->source,
+                  GRL_XML_DEBUG_OPERATION,
+                  data->source->priv->wc,
+                  data->operation->result->query,
+                  data->expand_data,
+                  data->cancellable,
+                  get_raw_from_operation,
+                  data_reffed,
+                  (DataFetchedCb) operation_call_data_fetched,
+                  data);
+  dataref_unref (data_reffed);
+}
+
+/* Returns the requirement of @operation on @key whose expression can be
+   indexed, if any */
+static OperationRequirement *
+operation_get_literal_requirement (Operation *operation,
+                                   GrlKeyID key)
+{
+  GList *req_list;
+  OperationRequirement *req;
+
+  for (req_list = operation->requirements;
+       req_list;
+       req_list = g_list_next (req_list)) {
+    req = (OperationRequirement *) req_list->data;
+    if (req->match_reg &&
+        req->key == key &&
+        operation_index_pattern_is_literal (g_regex_get_pattern (req->match_reg))) {
+      return req;
+    }
+  }
+
+  return NULL;
+}
+
+/* Indexes the operations of @type by the key most of them require to match
+   a literal, so selecting an operation does not need to test all of them */
+static void
+operations_build_index (GrlXmlFactorySource *source,
+                        gint type)
+{
+  GHashTable *counters;
+  GHashTableIter iter;
+  GList *operation_list;
+  GList *req_list;
+  GrlKeyID key = GRL_METADATA_KEY_INVALID;
+  OperationRequirement *req;
+  gpointer count;
+  gpointer req_key;
+  gint max_count = 0;
+
+  /* Count how many operations can be indexed by each key */
+  counters = g_hash_table_new (NULL, NULL);
+  for (operation_list = source->priv->operations[type];
+       operation_list;
+       operation_list = g_list_next (operation_list)) {
+    for (req_list = ((Operation *) operation_list->data)->requirements;
+         req_list;
+         req_list = g_list_next (req_list)) {
+      req = (OperationRequirement *) req_list->data;
+      if (req->match_reg &&
+          operation_index_pattern_is_literal (g_regex_get_pattern (req->match_reg))) {
+        count = g_hash_table_lookup (counters, GRLKEYID_TO_POINTER (req->key));
+        g_hash_table_insert (counters,
+                             GRLKEYID_TO_POINTER (req->key),
+                             GINT_TO_POINTER (GPOINTER_TO_INT (count) + 1));
+      }
+    }
+  }
+
+  g_hash_table_iter_init (&iter, counters);
+  while (g_hash_table_iter_next (&iter, &req_key, &count)) {
+    if (GPOINTER_TO_INT (count) > max_count) {
+      max_count = GPOINTER_TO_INT (count);
+      key = GRLPOINTER_TO_KEYID (req_key);
+    }
+  }
+  g_hash_table_unref (counters);
+
+  /* Not worth it */
+  if (max_count < 2) {
+    return;
+  }
+
+  source->priv->operations_key[type] = key;
+  source->priv->operations_index[type] = operation_index_new ();
+  for (operation_list = source->priv->operations[type];
+       operation_list;
+       operation_list = g_list_next (operation_list)) {
+    req = operation_get_literal_requirement (operation_list->data, key);
+    operation_index_add (source->priv->operations_index[type],
+                         operation_list->data,
+                         req? g_regex_get_pattern (req->match_reg): NULL);
   }
 }
 
@@ -3513,56 +4785,77 @@ operation_requirements_match (GrlXmlFactorySource *factory_source,
   return TRUE;
 }
 
+/* Returns the first operation of @type that matches @media. Only the
+   candidates given by the index, if any, are tested */
+static Operation *
+operations_select (GrlXmlFactorySource *factory_source,
+                   gint type,
+                   GrlMedia *media)
+{
+  GList *candidates;
+  GList *operation_list;
+  Operation *operation = NULL;
+  gboolean should_free;
+  gchar *key_value;
+
+  if (!media || !factory_source->priv->operations_index[type]) {
+    for (operation_list = factory_source->priv->operations[type];
+         operation_list;
+         operation_list = g_list_next (operation_list)) {
+      if (operation_requirements_match (factory_source, operation_list->data, media, NULL)) {
+        return operation_list->data;
+      }
+    }
+    return NULL;
+  }
+
+  key_value = get_data_as_string (media,
+                                  factory_source->priv->operations_key[type],
+                                  &should_free);
+  candidates = operation_index_lookup (factory_source->priv->operations_index[type],
+                                       key_value);
+  if (should_free) {
+    g_free (key_value);
+  }
+
+  for (operation_list = candidates;
+       operation_list;
+       operation_list = g_list_next (operation_list)) {
+    if (operation_requirements_match (factory_source, operation_list->data, media, NULL)) {
+      operation = operation_list->data;
+      break;
+    }
+  }
+  g_list_free (candidates);
+
+  return operation;
+}
+
 /* Selects the browse operation that matches the current container */
 static Operation *
 browse_select_operation (GrlSource *source,
                          GrlMedia *container)
 {
-  GList *operation_list;
   GrlXmlFactorySource *factory_source;
 
   factory_source = GRL_XML_FACTORY_SOURCE (source);
   GRL_XML_DEBUG_LITERAL (factory_source,
                          GRL_XML_DEBUG_OPERATION,
                          "  Selecting browse operation");
-  operation_list = (GList *) factory_source->priv->operations[OP_BROWSE];
-  while (operation_list) {
-    if (operation_requirements_match (factory_source, operation_list->data, container, NULL)) {
-      break;
-    }
-    operation_list = g_list_next (operation_list);
-  }
 
-  /* Nothing matches; send no results */
-  if (!operation_list) {
-    return NULL;
-  } else {
-    return operation_list->data;
-  }
+  /* If nothing matches, no results are sent */
+  return operations_select (factory_source, OP_BROWSE, container);
 }
 
 static Operation *
 resolve_select_operation (GrlSource *source,
                           GrlMedia *media)
 {
-  GList *operation_list;
   GrlXmlFactorySource *factory_source;
 
   factory_source = GRL_XML_FACTORY_SOURCE (source);
-  operation_list = (GList *) factory_source->priv->operations[OP_RESOLVE];
-  while (operation_list) {
-    if (operation_requirements_match (factory_source, operation_list->data, media, NULL)) {
-      break;
-    }
-    operation_list = g_list_next (operation_list);
-  }
 
-  /* Nothing matches */
-  if (!operation_list) {
-    return NULL;
-  } else {
-    return operation_list->data;
-  }
+  return operations_select (factory_source, OP_RESOLVE, media);
 }
 
 static OperationCallData *
@@ -3637,6 +4930,95 @@ grl_xml_factory_source_run_script (GrlXmlFactorySource *source,
   return result;
 }
 
+/* Stored in the regex cache for the patterns that can not be compiled, so
+   they are not compiled again */
+static gint regex_invalid;
+#define REGEX_INVALID ((GRegex *) &regex_invalid)
+
+static void
+regex_cache_value_free (GRegex *regex)
+{
+  if (regex != REGEX_INVALID) {
+    g_regex_unref (regex);
+  }
+}
+
+GRegex *
+grl_xml_factory_source_get_regex (GrlXmlFactorySource *source,
+                                  const gchar *pattern)
+{
+  GError *error = NULL;
+  GRegex *regex;
+
+  if (!pattern) {
+    return NULL;
+  }
+
+  if (!source->priv->regex_cache) {
+    source->priv->regex_cache = lru_cache_new (REGEX_CACHE_SIZE,
+                                               g_str_hash,
+                                               g_str_equal,
+                                               g_free,
+                                               (GDestroyNotify) regex_cache_value_free);
+  }
+
+  /* Cached expressions are reused, so they are worth optimizing */
+  regex = lru_cache_lookup (source->priv->regex_cache, pattern);
+  if (!regex) {
+    regex = g_regex_new (pattern, G_REGEX_OPTIMIZE, 0, &error);
+    if (!regex) {
+      GRL_DEBUG ("Wrong expression '%s': %s", pattern, error->message);
+      g_error_free (error);
+      regex = REGEX_INVALID;
+    }
+    lru_cache_insert (source->priv->regex_cache, g_strdup (pattern), regex);
+  }
+
+  if (regex == REGEX_INVALID) {
+    return NULL;
+  }
+
+  return g_regex_ref (regex);
+}
+
+Cache *
+grl_xml_factory_source_get_response_cache (GrlXmlFactorySource *source)
+{
+  if (!source->priv->response_cache) {
+    source->priv->response_cache = cache_new (RESPONSE_CACHE_SIZE,
+                                              (GDestroyNotify) dataref_unref);
+  }
+
+  return source->priv->response_cache;
+}
+
+GHashTable *
+grl_xml_factory_source_get_requests (GrlXmlFactorySource *source)
+{
+  if (!source->priv->requests) {
+    source->priv->requests = g_hash_table_new_full (g_str_hash,
+                                                    g_str_equal,
+                                                    g_free,
+                                                    NULL);
+  }
+
+  return source->priv->requests;
+}
+
+LruCache *
+grl_xml_factory_source_get_rest_proxies (GrlXmlFactorySource *source)
+{
+  if (!source->priv->rest_proxies) {
+    source->priv->rest_proxies = lru_cache_new (REST_PROXY_CACHE_SIZE,
+                                                g_str_hash,
+                                                g_str_equal,
+                                                g_free,
+                                                g_object_unref);
+  }
+
+  return source->priv->rest_proxies;
+}
+
 static const GList *
 grl_xml_factory_source_supported_keys (GrlSource *source)
 {
@@ -23,6 +23,9 @@
 #ifndef _GRL_XML_FACTORY_SOURCE_H_
 #define _GRL_XML_FACTORY_SOURCE_H_
 
+#include "cache.h"
+#include "lru-cache.h"
+
 #include <grilo.h>
 
 GRL_LOG_DOMAIN_EXTERN(xml_factory_log_domain);
@@ -87,4 +90,13 @@ gchar *grl_xml_factory_source_run_script (GrlXmlFactorySource *source,
                                           const gchar *script,
                                           GError **error);
 
+GRegex *grl_xml_factory_source_get_regex (GrlXmlFactorySource *source,
+                                          const gchar *pattern);
+
+Cache *grl_xml_factory_source_get_response_cache (GrlXmlFactorySource *source);
+
+GHashTable *grl_xml_factory_source_get_requests (GrlXmlFactorySource *source);
+
+LruCache *grl_xml_factory_source_get_rest_proxies (GrlXmlFactorySource *source);
+
 #endif /* _GRL_XML_FACTORY_SOURCE_H_ */
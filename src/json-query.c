@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "json-query.h"
+
+#include <string.h>
+
+/* JSONPath expressions that only access members and array elements, like
+   "$.data.items[*]" or "$.images[0].url", are resolved walking directly the
+   tree, without copying any node. Any other expression is handled by the
+   JSONPath engine */
+
+typedef struct {
+  gchar *member;
+  guint index;
+} JsonQueryStep;
+
+struct _JsonQuery {
+  JsonPath *path;
+  GArray *steps;
+  gboolean all;
+};
+
+static void
+json_query_free_steps (JsonQuery *query)
+{
+  guint i;
+
+  for (i = 0; i < query->steps->len; i++) {
+    g_free (g_array_index (query->steps, JsonQueryStep, i).member);
+  }
+  g_array_free (query->steps, TRUE);
+  query->steps = NULL;
+}
+
+/* Parses a member name enclosed in quotes, returning the position after the
+   closing quote, or NULL if it is not valid */
+static const gchar *
+json_query_parse_quoted (const gchar *expr,
+                         gchar **member)
+{
+  const gchar *end;
+
+  end = strchr (expr + 1, expr[0]);
+  if (!end || end == expr + 1 || end[1] != ']') {
+    return NULL;
+  }
+
+  *member = g_strndup (expr + 1, end - expr - 1);
+
+  return end + 2;
+}
+
+/* Splits @expression in steps; returns %FALSE if it is not a simple
+   expression */
+static gboolean
+json_query_parse (JsonQuery *query,
+                  const gchar *expression)
+{
+  JsonQueryStep step;
+  const gchar *expr;
+  gchar *end;
+  gsize len;
+
+  if (expression[0] != '$') {
+    return FALSE;
+  }
+
+  query->steps = g_array_new (FALSE, FALSE, sizeof (JsonQueryStep));
+
+  for (expr = expression + 1; *expr; ) {
+    /* A wildcard is allowed only as last step */
+    if (query->all) {
+      return FALSE;
+    }
+
+    step.member = NULL;
+    step.index = 0;
+
+    if (expr[0] == '.') {
+      expr++;
+      if (expr[0] == '*') {
+        query->all = TRUE;
+        expr++;
+        continue;
+      }
+      len = strcspn (expr, ".[*()?@$ ");
+      if (len == 0) {
+        return FALSE;
+      }
+      step.member = g_strndup (expr, len);
+      expr += len;
+    } else if (expr[0] == '[') {
+      expr++;
+      if (expr[0] == '*' && expr[1] == ']') {
+        query->all = TRUE;
+        expr += 2;
+        continue;
+      }
+      if (expr[0] == '\'' || expr[0] == '"') {
+        expr = json_query_parse_quoted (expr, &step.member);
+        if (!expr) {
+          return FALSE;
+        }
+      } else if (g_ascii_isdigit (expr[0])) {
+        step.index = (guint) g_ascii_strtoull (expr, &end, 10);
+        if (end[0] != ']') {
+          return FALSE;
+        }
+        expr = end + 1;
+      } else {
+        return FALSE;
+      }
+    } else {
+      return FALSE;
+    }
+
+    g_array_append_val (query->steps, step);
+  }
+
+  return TRUE;
+}
+
+JsonQuery *
+json_query_new (const gchar *expression,
+                GError **error)
+{
+  JsonQuery *query;
+
+  query = g_slice_new0 (JsonQuery);
+  query->path = json_path_new ();
+  if (!json_path_compile (query->path, expression, error)) {
+    json_query_free (query);
+    return NULL;
+  }
+
+  if (!json_query_parse (query, expression) && query->steps) {
+    json_query_free_steps (query);
+  }
+
+  return query;
+}
+
+void
+json_query_free (JsonQuery *query)
+{
+  if (query->steps) {
+    json_query_free_steps (query);
+  }
+  g_object_unref (query->path);
+  g_slice_free (JsonQuery, query);
+}
+
+/* %TRUE if @query selects at most one node, which is found without copying
+   anything */
+gboolean
+json_query_is_simple (JsonQuery *query)
+{
+  return query->steps && !query->all;
+}
+
+/* Walks the steps from @root, returning the node found or NULL */
+static JsonNode *
+json_query_walk (JsonQuery *query,
+                 JsonNode *root)
+{
+  JsonArray *array;
+  JsonNode *node = root;
+  JsonObject *object;
+  JsonQueryStep *step;
+  guint i;
+
+  for (i = 0; node && i < query->steps->len; i++) {
+    step = &g_array_index (query->steps, JsonQueryStep, i);
+    if (step->member) {
+      if (!JSON_NODE_HOLDS_OBJECT (node)) {
+        return NULL;
+      }
+      object = json_node_get_object (node);
+      node = json_object_get_member (object, step->member);
+    } else {
+      if (!JSON_NODE_HOLDS_ARRAY (node)) {
+        return NULL;
+      }
+      array = json_node_get_array (node);
+      if (step->index >= json_array_get_length (array)) {
+        return NULL;
+      }
+      node = json_array_get_element (array, step->index);
+    }
+  }
+
+  return node;
+}
+
+/* Adds to @nodes all the nodes matching @query in @root. If the JSONPath
+   engine is used, it returns the array with the matches, which must be kept
+   while @nodes are used, and freed with json_node_free() */
+JsonNode *
+json_query_match (JsonQuery *query,
+                  JsonNode *root,
+                  GPtrArray *nodes)
+{
+  JsonArray *array;
+  JsonNode *matches;
+  JsonNode *node;
+  guint i;
+  guint length;
+
+  if (query->steps) {
+    node = json_query_walk (query, root);
+    if (!node) {
+      return NULL;
+    }
+    if (!query->all) {
+      g_ptr_array_add (nodes, node);
+      return NULL;
+    }
+    if (JSON_NODE_HOLDS_ARRAY (node)) {
+      array = json_node_get_array (node);
+      length = json_array_get_length (array);
+      for (i = 0; i < length; i++) {
+        g_ptr_array_add (nodes, json_array_get_element (array, i));
+      }
+      return NULL;
+    }
+  }
+
+  matches = json_path_match (query->path, root);
+  if (matches) {
+    array = json_node_get_array (matches);
+    length = json_array_get_length (array);
+    for (i = 0; i < length; i++) {
+      g_ptr_array_add (nodes, json_array_get_element (array, i));
+    }
+  }
+
+  return matches;
+}
+
+/* Returns the first node matching @query in @root, or NULL. If the JSONPath
+   engine is used, @matches is set to the array with the matches, which must
+   be freed with json_node_free() once the node is not needed */
+JsonNode *
+json_query_match_first (JsonQuery *query,
+                        JsonNode *root,
+                        JsonNode **matches)
+{
+  JsonArray *array;
+  JsonNode *node;
+
+  *matches = NULL;
+
+  if (query->steps) {
+    node = json_query_walk (query, root);
+    if (!node || !query->all) {
+      return node;
+    }
+    if (JSON_NODE_HOLDS_ARRAY (node)) {
+      array = json_node_get_array (node);
+      if (json_array_get_length (array) == 0) {
+        return NULL;
+      }
+      return json_array_get_element (array, 0);
+    }
+  }
+
+  *matches = json_path_match (query->path, root);
+  if (!*matches) {
+    return NULL;
+  }
+
+  array = json_node_get_array (*matches);
+  if (json_array_get_length (array) == 0) {
+    return NULL;
+  }
+
+  return json_array_get_element (array, 0);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _JSON_QUERY_H_
+#define _JSON_QUERY_H_
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+typedef struct _JsonQuery JsonQuery;
+
+JsonQuery *json_query_new (const gchar *expression,
+                           GError **error);
+
+void json_query_free (JsonQuery *query);
+
+gboolean json_query_is_simple (JsonQuery *query);
+
+JsonNode *json_query_match (JsonQuery *query,
+                            JsonNode *root,
+                            GPtrArray *nodes);
+
+JsonNode *json_query_match_first (JsonQuery *query,
+                                  JsonNode *root,
+                                  JsonNode **matches);
+
+#endif /* _JSON_QUERY_H_ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "lru-cache.h"
+
+/* A hash table with a bounded number of entries. Entries are kept in a queue
+   sorted by last use, so when the cache is full the least recently used one
+   is dropped */
+
+typedef struct {
+  gpointer key;
+  gpointer value;
+} LruEntry;
+
+struct _LruCache {
+  guint max_size;
+  GHashTable *entries;
+  GQueue queue;
+  GDestroyNotify key_destroy_func;
+  GDestroyNotify value_destroy_func;
+};
+
+static void
+lru_entry_free (LruCache *cache,
+                LruEntry *entry)
+{
+  if (cache->key_destroy_func) {
+    cache->key_destroy_func (entry->key);
+  }
+  if (cache->value_destroy_func) {
+    cache->value_destroy_func (entry->value);
+  }
+  g_slice_free (LruEntry, entry);
+}
+
+static void
+lru_cache_remove_link (LruCache *cache,
+                       GList *link)
+{
+  LruEntry *entry = (LruEntry *) link->data;
+
+  g_hash_table_remove (cache->entries, entry->key);
+  g_queue_delete_link (&cache->queue, link);
+  lru_entry_free (cache, entry);
+}
+
+LruCache *
+lru_cache_new (guint max_size,
+               GHashFunc hash_func,
+               GEqualFunc key_equal_func,
+               GDestroyNotify key_destroy_func,
+               GDestroyNotify value_destroy_func)
+{
+  LruCache *cache;
+
+  cache = g_slice_new (LruCache);
+  cache->max_size = MAX (max_size, 1);
+  cache->entries = g_hash_table_new (hash_func, key_equal_func);
+  g_queue_init (&cache->queue);
+  cache->key_destroy_func = key_destroy_func;
+  cache->value_destroy_func = value_destroy_func;
+
+  return cache;
+}
+
+void
+lru_cache_free (LruCache *cache)
+{
+  LruEntry *entry;
+
+  if (!cache) {
+    return;
+  }
+
+  g_hash_table_unref (cache->entries);
+  while ((entry = g_queue_pop_head (&cache->queue)) != NULL) {
+    lru_entry_free (cache, entry);
+  }
+
+  g_slice_free (LruCache, cache);
+}
+
+/* Returns the value for the key, or NULL if it is not in the cache. The entry
+   becomes the most recently used one */
+gpointer
+lru_cache_lookup (LruCache *cache,
+                  gconstpointer key)
+{
+  GList *link;
+
+  link = g_hash_table_lookup (cache->entries, key);
+  if (!link) {
+    return NULL;
+  }
+
+  if (link != cache->queue.head) {
+    g_queue_unlink (&cache->queue, link);
+    g_queue_push_head_link (&cache->queue, link);
+  }
+
+  return ((LruEntry *) link->data)->value;
+}
+
+/* Inserts a new entry, taking ownership of key and value. An entry with the
+   same key is replaced */
+void
+lru_cache_insert (LruCache *cache,
+                  gpointer key,
+                  gpointer value)
+{
+  GList *link;
+  LruEntry *entry;
+
+  link = g_hash_table_lookup (cache->entries, key);
+  if (link) {
+    lru_cache_remove_link (cache, link);
+  }
+
+  while (cache->queue.length >= cache->max_size) {
+    lru_cache_remove_link (cache, cache->queue.tail);
+  }
+
+  entry = g_slice_new (LruEntry);
+  entry->key = key;
+  entry->value = value;
+  g_queue_push_head (&cache->queue, entry);
+  g_hash_table_insert (cache->entries, key, cache->queue.head);
+}
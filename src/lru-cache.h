@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _LRU_CACHE_H_
+#define _LRU_CACHE_H_
+
+#include <glib.h>
+
+typedef struct _LruCache LruCache;
+
+LruCache *lru_cache_new (guint max_size,
+                         GHashFunc hash_func,
+                         GEqualFunc key_equal_func,
+                         GDestroyNotify key_destroy_func,
+                         GDestroyNotify value_destroy_func);
+
+void lru_cache_free (LruCache *cache);
+
+gpointer lru_cache_lookup (LruCache *cache,
+                           gconstpointer key);
+
+void lru_cache_insert (LruCache *cache,
+                       gpointer key,
+                       gpointer value);
+
+#endif /* _LRU_CACHE_H_ */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <string.h>
+
+#include "operation-index.h"
+
+/* Index to find the items whose regular expression could match a value,
+   without testing all of them. Expressions that are anchored literals are
+   indexed: "^literal$" in a table of exact values, and "^literal" in a table
+   of prefixes, probed once for each different prefix length. The rest of
+   expressions are candidates for any value.
+
+   Items are returned in the same order they were added. Candidates are not
+   guaranteed to match, as only one expression per item is indexed; caller
+   must check them */
+
+#define REGEX_SPECIAL_CHARS "\\^$.|?*+()[]{}"
+
+typedef struct {
+  guint position;
+  gpointer item;
+} IndexEntry;
+
+struct _OperationIndex {
+  guint count;
+  GHashTable *exact;
+  GHashTable *prefixes;
+  GArray *prefix_lengths;
+  GPtrArray *generic;
+};
+
+static void
+index_entries_free (GPtrArray *entries)
+{
+  guint i;
+
+  for (i = 0; i < entries->len; i++) {
+    g_slice_free (IndexEntry, g_ptr_array_index (entries, i));
+  }
+  g_ptr_array_free (entries, TRUE);
+}
+
+static void
+index_table_add (GHashTable *table,
+                 gchar *key,
+                 IndexEntry *entry)
+{
+  GPtrArray *entries;
+
+  entries = g_hash_table_lookup (table, key);
+  if (!entries) {
+    entries = g_ptr_array_new ();
+    g_hash_table_insert (table, key, entries);
+  } else {
+    g_free (key);
+  }
+  g_ptr_array_add (entries, entry);
+}
+
+static void
+index_add_prefix_length (OperationIndex *index,
+                         guint length)
+{
+  guint i;
+
+  for (i = 0; i < index->prefix_lengths->len; i++) {
+    if (g_array_index (index->prefix_lengths, guint, i) == length) {
+      return;
+    }
+  }
+  g_array_append_val (index->prefix_lengths, length);
+}
+
+static void
+index_collect (GPtrArray *all,
+               GHashTable *table,
+               const gchar *key)
+{
+  GPtrArray *entries;
+
+  entries = g_hash_table_lookup (table, key);
+  if (entries) {
+    g_ptr_array_add (all, entries);
+  }
+}
+
+OperationIndex *
+operation_index_new (void)
+{
+  OperationIndex *index;
+
+  index = g_slice_new (OperationIndex);
+  index->count = 0;
+  index->exact = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify) index_entries_free);
+  index->prefixes = g_hash_table_new_full (g_str_hash,
+                                           g_str_equal,
+                                           g_free,
+                                           (GDestroyNotify) index_entries_free);
+  index->prefix_lengths = g_array_new (FALSE, FALSE, sizeof (guint));
+  index->generic = g_ptr_array_new ();
+
+  return index;
+}
+
+void
+operation_index_free (OperationIndex *index)
+{
+  g_hash_table_unref (index->exact);
+  g_hash_table_unref (index->prefixes);
+  g_array_free (index->prefix_lengths, TRUE);
+  index_entries_free (index->generic);
+  g_slice_free (OperationIndex, index);
+}
+
+/* Returns %TRUE if @pattern is "^literal" or "^literal$", with a non-empty
+   literal without special characters */
+gboolean
+operation_index_pattern_is_literal (const gchar *pattern)
+{
+  gsize length;
+
+  if (!pattern || pattern[0] != '^') {
+    return FALSE;
+  }
+
+  length = strcspn (pattern + 1, REGEX_SPECIAL_CHARS);
+  if (length == 0) {
+    return FALSE;
+  }
+
+  return pattern[length + 1] == '\0' ||
+    (pattern[length + 1] == '$' && pattern[length + 2] == '\0');
+}
+
+/* Adds @item to the index. If @pattern is not a literal, @item is a
+   candidate for any value */
+void
+operation_index_add (OperationIndex *index,
+                     gpointer item,
+                     const gchar *pattern)
+{
+  IndexEntry *entry;
+  gsize length;
+
+  entry = g_slice_new (IndexEntry);
+  entry->position = index->count++;
+  entry->item = item;
+
+  if (!operation_index_pattern_is_literal (pattern)) {
+    g_ptr_array_add (index->generic, entry);
+    return;
+  }
+
+  length = strlen (pattern + 1);
+  if (pattern[length] == '$') {
+    index_table_add (index->exact, g_strndup (pattern + 1, length - 1), entry);
+  } else {
+    index_table_add (index->prefixes, g_strdup (pattern + 1), entry);
+    index_add_prefix_length (index, length);
+  }
+}
+
+/* Returns the items that could match @value, in the order they were added.
+   Free the list with g_list_free() */
+GList *
+operation_index_lookup (OperationIndex *index,
+                        const gchar *value)
+{
+  GList *candidates = NULL;
+  GPtrArray *all;
+  GPtrArray *entries;
+  IndexEntry *entry;
+  IndexEntry *next;
+  gchar *prefix;
+  gsize length;
+  guint *heads;
+  guint i;
+  guint length_prefix;
+  guint selected;
+
+  all = g_ptr_array_new ();
+  g_ptr_array_add (all, index->generic);
+
+  if (!value) {
+    value = "";
+  }
+  length = strlen (value);
+
+  index_collect (all, index->exact, value);
+  /* "$" also matches before a trailing newline */
+  if (length > 0 && value[length - 1] == '\n') {
+    prefix = g_strndup (value, length - 1);
+    index_collect (all, index->exact, prefix);
+    g_free (prefix);
+  }
+
+  for (i = 0; i < index->prefix_lengths->len; i++) {
+    length_prefix = g_array_index (index->prefix_lengths, guint, i);
+    if (length_prefix <= length) {
+      prefix = g_strndup (value, length_prefix);
+      index_collect (all, index->prefixes, prefix);
+      g_free (prefix);
+    }
+  }
+
+  /* Merge the lists, which are sorted by position */
+  heads = g_new0 (guint, all->len);
+  for (;;) {
+    entry = NULL;
+    selected = 0;
+    for (i = 0; i < all->len; i++) {
+      entries = g_ptr_array_index (all, i);
+      if (heads[i] < entries->len) {
+        next = g_ptr_array_index (entries, heads[i]);
+        if (!entry || next->position < entry->position) {
+          entry = next;
+          selected = i;
+        }
+      }
+    }
+    if (!entry) {
+      break;
+    }
+    heads[selected]++;
+    candidates = g_list_prepend (candidates, entry->item);
+  }
+
+  g_free (heads);
+  g_ptr_array_free (all, TRUE);
+
+  return g_list_reverse (candidates);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _OPERATION_INDEX_H_
+#define _OPERATION_INDEX_H_
+
+#include <glib.h>
+
+typedef struct _OperationIndex OperationIndex;
+
+OperationIndex *operation_index_new (void);
+
+void operation_index_free (OperationIndex *index);
+
+gboolean operation_index_pattern_is_literal (const gchar *pattern);
+
+void operation_index_add (OperationIndex *index,
+                          gpointer item,
+                          const gchar *pattern);
+
+GList *operation_index_lookup (OperationIndex *index,
+                               const gchar *value);
+
+#endif /* _OPERATION_INDEX_H_ */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "private-keys.h"
+
+#include "json-ghashtable.h"
+
+#include <string.h>
+
+/* Private keys are stored in the media as a JSON string, so they survive
+   serializing the media. To avoid parsing it each time, the decoded table
+   is attached to the media together with the JSON string it comes from */
+
+typedef struct {
+  gchar *json;
+  GHashTable *table;
+} PrivateKeysCache;
+
+static GrlKeyID
+private_keys_key (void)
+{
+  static GrlKeyID GRL_METADATA_KEY_PRIVATE_KEYS = 0;
+  GrlRegistry *registry;
+
+  if (!GRL_METADATA_KEY_PRIVATE_KEYS) {
+    registry = grl_registry_get_default ();
+    GRL_METADATA_KEY_PRIVATE_KEYS = grl_registry_lookup_metadata_key (registry,
+                                                                      "xml-factory-private-keys");
+  }
+
+  return GRL_METADATA_KEY_PRIVATE_KEYS;
+}
+
+static GQuark
+private_keys_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (!quark) {
+    quark = g_quark_from_static_string ("xml-factory-private-keys-cache");
+  }
+
+  return quark;
+}
+
+static void
+private_keys_cache_free (PrivateKeysCache *cache)
+{
+  g_free (cache->json);
+  g_hash_table_unref (cache->table);
+  g_slice_free (PrivateKeysCache, cache);
+}
+
+static void
+private_keys_cache_attach (GrlMedia *media,
+                           const gchar *json,
+                           GHashTable *table)
+{
+  PrivateKeysCache *cache;
+
+  cache = g_slice_new (PrivateKeysCache);
+  cache->json = g_strdup (json);
+  cache->table = table;
+
+  g_object_set_qdata_full (G_OBJECT (media),
+                           private_keys_quark (),
+                           cache,
+                           (GDestroyNotify) private_keys_cache_free);
+}
+
+static void
+append_json_string (GString *json,
+                    const gchar *str)
+{
+  const gchar *p;
+
+  g_string_append_c (json, '"');
+  for (p = str; *p; p++) {
+    switch (*p) {
+    case '"':
+      g_string_append (json, "\\\"");
+      break;
+    case '\\':
+      g_string_append (json, "\\\\");
+      break;
+    case '\b':
+      g_string_append (json, "\\b");
+      break;
+    case '\f':
+      g_string_append (json, "\\f");
+      break;
+    case '\n':
+      g_string_append (json, "\\n");
+      break;
+    case '\r':
+      g_string_append (json, "\\r");
+      break;
+    case '\t':
+      g_string_append (json, "\\t");
+      break;
+    default:
+      if ((guchar) *p < 0x20) {
+        g_string_append_printf (json, "\\u%04x", (guchar) *p);
+      } else {
+        g_string_append_c (json, *p);
+      }
+      break;
+    }
+  }
+  g_string_append_c (json, '"');
+}
+
+/* Writes the table as a JSON object, with the same output that
+   json_ghashtable_serialize_data() produces */
+static gchar *
+private_keys_serialize (GHashTable *private_keys)
+{
+  GHashTableIter iter;
+  GString *json;
+  gboolean first = TRUE;
+  gchar *name;
+  gchar *value;
+
+  json = g_string_sized_new (64 * g_hash_table_size (private_keys));
+  g_string_append_c (json, '{');
+
+  g_hash_table_iter_init (&iter, private_keys);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &value)) {
+    if (!value) {
+      continue;
+    }
+    if (!first) {
+      g_string_append_c (json, ',');
+    }
+    append_json_string (json, name);
+    g_string_append_c (json, ':');
+    append_json_string (json, value);
+    first = FALSE;
+  }
+
+  g_string_append_c (json, '}');
+
+  return g_string_free (json, FALSE);
+}
+
+/* Returns the private keys stored in the media, or NULL if it has none. The
+   table is owned by the media; ref it to keep it around */
+GHashTable *
+private_keys_get (GrlMedia *media)
+{
+  GHashTable *table;
+  PrivateKeysCache *cache;
+  const gchar *json;
+
+  if (!media) {
+    return NULL;
+  }
+
+  json = grl_data_get_string (GRL_DATA (media), private_keys_key ());
+  if (!json) {
+    return NULL;
+  }
+
+  cache = g_object_get_qdata (G_OBJECT (media), private_keys_quark ());
+  if (cache && strcmp (cache->json, json) == 0) {
+    return cache->table;
+  }
+
+  /* Keys were set somewhere else (e.g. the media was deserialized) */
+  table = json_ghashtable_deserialize_data (json, -1, NULL);
+  if (!table) {
+    return NULL;
+  }
+
+  private_keys_cache_attach (media, json, table);
+
+  return table;
+}
+
+/* Stores the private keys in the media, taking ownership of the table */
+void
+private_keys_set (GrlMedia *media,
+                  GHashTable *private_keys)
+{
+  gchar *json;
+
+  json = private_keys_serialize (private_keys);
+  grl_data_set_string (GRL_DATA (media), private_keys_key (), json);
+  private_keys_cache_attach (media, json, private_keys);
+  g_free (json);
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <libsoup/soup.h>
+#include <string.h>
+
+#include "test-server.h"
+
+/* Minimal HTTP server to test how sources use the network. Each path serves
+   a fixed content, returning 404 when there is none, and answers conditional
+   requests with 304 when the validators match. Requests to a path can be held
+   until the test releases them, to have several requests in flight */
+
+typedef struct {
+  gchar *content;
+  gchar *etag;
+  gchar *last_modified;
+  guint requests;
+  GHashTable *request_headers;
+  gboolean held;
+  GList *held_messages;
+} TestResource;
+
+struct _TestServer {
+  SoupServer *server;
+  gchar *uri;
+  GHashTable *resources;
+};
+
+static void
+test_resource_free (TestResource *resource)
+{
+  g_free (resource->content);
+  g_free (resource->etag);
+  g_free (resource->last_modified);
+  g_hash_table_unref (resource->request_headers);
+  g_list_free (resource->held_messages);
+  g_slice_free (TestResource, resource);
+}
+
+static TestResource *
+test_server_get_resource (TestServer *server,
+                          const gchar *path)
+{
+  TestResource *resource;
+
+  resource = g_hash_table_lookup (server->resources, path);
+  if (!resource) {
+    resource = g_slice_new0 (TestResource);
+    resource->request_headers = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       g_free,
+                                                       g_free);
+    g_hash_table_insert (server->resources, g_strdup (path), resource);
+  }
+
+  return resource;
+}
+
+static void
+test_resource_save_header (const gchar *name,
+                           const gchar *value,
+                           TestResource *resource)
+{
+  g_hash_table_insert (resource->request_headers,
+                       g_ascii_strdown (name, -1),
+                       g_strdup (value));
+}
+
+static gboolean
+test_resource_is_not_modified (TestResource *resource)
+{
+  const gchar *value;
+
+  value = g_hash_table_lookup (resource->request_headers, "if-none-match");
+  if (value && resource->etag) {
+    return g_strcmp0 (value, resource->etag) == 0;
+  }
+
+  value = g_hash_table_lookup (resource->request_headers, "if-modified-since");
+  if (value && resource->last_modified) {
+    return g_strcmp0 (value, resource->last_modified) == 0;
+  }
+
+  return FALSE;
+}
+
+static void
+test_server_message_finished (SoupMessage *msg,
+                              TestResource *resource)
+{
+  resource->held_messages = g_list_remove (resource->held_messages, msg);
+}
+
+static void
+test_server_handler (SoupServer *soup_server,
+                     SoupMessage *msg,
+                     const char *path,
+                     GHashTable *query,
+                     SoupClientContext *client,
+                     TestServer *server)
+{
+  TestResource *resource;
+
+  resource = test_server_get_resource (server, path);
+  resource->requests++;
+  g_hash_table_remove_all (resource->request_headers);
+  soup_message_headers_foreach (msg->request_headers,
+                                (SoupMessageHeadersForeachFunc) test_resource_save_header,
+                                resource);
+
+  if (!resource->content) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+  } else if (test_resource_is_not_modified (resource)) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED);
+  } else {
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+    soup_message_set_response (msg, "text/xml", SOUP_MEMORY_COPY,
+                               resource->content,
+                               strlen (resource->content));
+  }
+
+  if (resource->etag) {
+    soup_message_headers_replace (msg->response_headers,
+                                  "ETag", resource->etag);
+  }
+  if (resource->last_modified) {
+    soup_message_headers_replace (msg->response_headers,
+                                  "Last-Modified", resource->last_modified);
+  }
+
+  if (resource->held) {
+    soup_server_pause_message (soup_server, msg);
+    resource->held_messages = g_list_append (resource->held_messages, msg);
+    g_signal_connect (msg, "finished",
+                      G_CALLBACK (test_server_message_finished),
+                      resource);
+  }
+}
+
+TestServer *
+test_server_new (void)
+{
+  TestServer *server;
+
+  server = g_slice_new0 (TestServer);
+  server->server = soup_server_new (SOUP_SERVER_PORT, 0, NULL);
+  g_assert (server->server);
+  server->uri = g_strdup_printf ("http://127.0.0.1:%u",
+                                 soup_server_get_port (server->server));
+  server->resources = g_hash_table_new_full (g_str_hash,
+                                             g_str_equal,
+                                             g_free,
+                                             (GDestroyNotify) test_resource_free);
+
+  soup_server_add_handler (server->server, NULL,
+                           (SoupServerCallback) test_server_handler,
+                           server, NULL);
+  soup_server_run_async (server->server);
+
+  return server;
+}
+
+void
+test_server_free (TestServer *server)
+{
+  soup_server_quit (server->server);
+  g_object_unref (server->server);
+  g_hash_table_unref (server->resources);
+  g_free (server->uri);
+  g_slice_free (TestServer, server);
+}
+
+/* Returns the URI of the server, without the trailing '/' */
+const gchar *
+test_server_get_uri (TestServer *server)
+{
+  return server->uri;
+}
+
+/* Sets the content served for @path; if it is NULL, the path is not found */
+void
+test_server_set_content (TestServer *server,
+                         const gchar *path,
+                         const gchar *content)
+{
+  TestResource *resource;
+
+  resource = test_server_get_resource (server, path);
+  g_free (resource->content);
+  resource->content = g_strdup (content);
+}
+
+void
+test_server_set_validators (TestServer *server,
+                            const gchar *path,
+                            const gchar *etag,
+                            const gchar *last_modified)
+{
+  TestResource *resource;
+
+  resource = test_server_get_resource (server, path);
+  g_free (resource->etag);
+  resource->etag = g_strdup (etag);
+  g_free (resource->last_modified);
+  resource->last_modified = g_strdup (last_modified);
+}
+
+/* Returns how many requests were received for @path */
+guint
+test_server_get_requests (TestServer *server,
+                          const gchar *path)
+{
+  return test_server_get_resource (server, path)->requests;
+}
+
+/* Returns the value of header @name in the last request for @path */
+const gchar *
+test_server_get_request_header (TestServer *server,
+                                const gchar *path,
+                                const gchar *name)
+{
+  TestResource *resource;
+  const gchar *value;
+  gchar *lower_name;
+
+  resource = test_server_get_resource (server, path);
+  lower_name = g_ascii_strdown (name, -1);
+  value = g_hash_table_lookup (resource->request_headers, lower_name);
+  g_free (lower_name);
+
+  return value;
+}
+
+/* Runs the main loop until @requests requests were received for @path */
+void
+test_server_wait_requests (TestServer *server,
+                           const gchar *path,
+                           guint requests)
+{
+  while (test_server_get_requests (server, path) < requests) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+}
+
+/* Holds the responses to @path until test_server_release() is called */
+void
+test_server_hold (TestServer *server,
+                  const gchar *path)
+{
+  test_server_get_resource (server, path)->held = TRUE;
+}
+
+void
+test_server_release (TestServer *server,
+                     const gchar *path)
+{
+  GList *messages;
+  GList *msg;
+  TestResource *resource;
+
+  resource = test_server_get_resource (server, path);
+  resource->held = FALSE;
+  messages = resource->held_messages;
+  resource->held_messages = NULL;
+
+  for (msg = messages; msg; msg = g_list_next (msg)) {
+    g_signal_handlers_disconnect_by_func (msg->data,
+                                          test_server_message_finished,
+                                          resource);
+    soup_server_unpause_message (server->server, msg->data);
+  }
+  g_list_free (messages);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _TEST_SERVER_H_
+#define _TEST_SERVER_H_
+
+#include <glib.h>
+
+typedef struct _TestServer TestServer;
+
+TestServer *test_server_new (void);
+
+void test_server_free (TestServer *server);
+
+const gchar *test_server_get_uri (TestServer *server);
+
+void test_server_set_content (TestServer *server,
+                              const gchar *path,
+                              const gchar *content);
+
+void test_server_set_validators (TestServer *server,
+                                 const gchar *path,
+                                 const gchar *etag,
+                                 const gchar *last_modified);
+
+guint test_server_get_requests (TestServer *server,
+                                const gchar *path);
+
+const gchar *test_server_get_request_header (TestServer *server,
+                                             const gchar *path,
+                                             const gchar *name);
+
+void test_server_wait_requests (TestServer *server,
+                                const gchar *path,
+                                guint requests);
+
+void test_server_hold (TestServer *server,
+                       const gchar *path);
+
+void test_server_release (TestServer *server,
+                          const gchar *path);
+
+#endif /* _TEST_SERVER_H_ */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Author: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <grilo.h>
+
+#include "test-server.h"
+
+#define XML_FACTORY_ID "grl-xml-factory"
+
+/* Memory budget (in KiB) of the results cache shared by all the sources */
+#define CACHE_SIZE 32
+
+/* Sizes of the results; the cache can hold two medium ones, but not three */
+#define SMALL_PADDING 256
+#define MEDIUM_PADDING (12 * 1024)
+#define BIG_PADDING (20 * 1024)
+
+/* Time the slow result takes to be obtained, in milliseconds */
+#define SLOW_DELAY 500
+
+static TestServer *server = NULL;
+
+static void
+test_xml_factory_setup (void)
+{
+  GError *error = NULL;
+  GrlConfig *config;
+  GrlRegistry *registry;
+
+  server = test_server_new ();
+
+  registry = grl_registry_get_default ();
+  config = grl_config_new (XML_FACTORY_ID, NULL);
+  grl_config_set_string (config, "server", test_server_get_uri (server));
+  grl_config_set_int (config, "cache-size", CACHE_SIZE);
+  grl_registry_add_config (registry, config, &error);
+  g_assert_no_error (error);
+
+  grl_registry_load_all_plugins (registry, &error);
+  g_assert_no_error (error);
+}
+
+static GrlSource *
+get_source (const gchar *id)
+{
+  GrlRegistry *registry;
+  GrlSource *source;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, id);
+  g_assert (source);
+
+  return source;
+}
+
+static guint64
+get_cache_usage (GrlSource *source)
+{
+  guint64 usage;
+
+  g_object_get (source, "cache-usage", &usage, NULL);
+
+  return usage;
+}
+
+static void
+set_content (const gchar *path,
+             gsize padding_size)
+{
+  gchar *content;
+  gchar *padding;
+
+  padding = g_strnfill (padding_size, 'x');
+  content = g_strdup_printf ("<data><title>Title</title><padding>%s</padding></data>",
+                             padding);
+  test_server_set_content (server, path, content);
+  g_free (content);
+  g_free (padding);
+}
+
+static void
+search (GrlSource *source,
+        const gchar *text)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlOperationOptions *options;
+
+  options = grl_operation_options_new (NULL);
+  medias = grl_source_search_sync (source,
+                                   text,
+                                   grl_source_supported_keys (source),
+                                   options,
+                                   &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_list_length (medias), ==, 1);
+
+  g_list_free_full (medias, g_object_unref);
+  g_object_unref (options);
+}
+
+static gboolean
+release_slow (gpointer user_data)
+{
+  test_server_release (server, "/cache-size-three-slow");
+
+  return FALSE;
+}
+
+/* Tests below share the cache, and each one relies on what the previous ones
+   left in it */
+
+static void
+test_xml_factory_cache_remove_owner (void)
+{
+  GError *error = NULL;
+  GrlRegistry *registry;
+  GrlSource *one;
+  GrlSource *three;
+
+  one = get_source ("xml-test-cache-size-one");
+  three = get_source ("xml-test-cache-size-three");
+
+  set_content ("/cache-size-three-slow", MEDIUM_PADDING);
+  set_content ("/cache-size-one-first", MEDIUM_PADDING);
+  set_content ("/cache-size-one-second", MEDIUM_PADDING);
+
+  /* The result of the third source is the most expensive to obtain again */
+  test_server_hold (server, "/cache-size-three-slow");
+  g_timeout_add (SLOW_DELAY, release_slow, NULL);
+  search (three, "slow");
+  search (one, "first");
+  g_assert_cmpuint (get_cache_usage (three), >, MEDIUM_PADDING);
+  g_assert_cmpuint (get_cache_usage (one), >, MEDIUM_PADDING);
+
+  /* Its results are dropped when it is finalized */
+  registry = grl_registry_get_default ();
+  g_object_add_weak_pointer (G_OBJECT (three), (gpointer *) &three);
+  grl_registry_unregister_source (registry, three, &error);
+  g_assert_no_error (error);
+  while (three && g_main_context_iteration (NULL, FALSE));
+  g_assert (!three);
+
+  /* So there is room for a new result without dropping the first one */
+  search (one, "second");
+  g_assert_cmpuint (get_cache_usage (one), >, 2 * MEDIUM_PADDING);
+}
+
+static void
+test_xml_factory_cache_usage (void)
+{
+  GrlSource *one;
+  GrlSource *two;
+  guint64 one_usage;
+
+  one = get_source ("xml-test-cache-size-one");
+  two = get_source ("xml-test-cache-size-two");
+  one_usage = get_cache_usage (one);
+
+  /* Each source accounts only its own results */
+  set_content ("/cache-size-two-small", SMALL_PADDING);
+  search (two, "small");
+  g_assert_cmpuint (get_cache_usage (two), >, SMALL_PADDING);
+  g_assert_cmpuint (get_cache_usage (two), <, MEDIUM_PADDING);
+  g_assert_cmpuint (get_cache_usage (one), ==, one_usage);
+}
+
+static void
+test_xml_factory_cache_evict (void)
+{
+  GrlSource *one;
+  GrlSource *two;
+  guint64 one_usage;
+
+  one = get_source ("xml-test-cache-size-one");
+  two = get_source ("xml-test-cache-size-two");
+  one_usage = get_cache_usage (one);
+
+  /* Results are dropped to keep the cache within its budget */
+  set_content ("/cache-size-two-big", BIG_PADDING);
+  search (two, "big");
+  g_assert_cmpuint (get_cache_usage (two), >, BIG_PADDING);
+  g_assert_cmpuint (get_cache_usage (one) + get_cache_usage (two),
+                    <=,
+                    CACHE_SIZE * 1024);
+  g_assert_cmpuint (get_cache_usage (one), <, one_usage);
+}
+
+int
+main(int argc, char **argv)
+{
+  gint result;
+
+  g_setenv ("GRL_PLUGIN_PATH", XML_FACTORY_PLUGIN_PATH, TRUE);
+  g_setenv ("GRL_PLUGIN_LIST", XML_FACTORY_ID, TRUE);
+  g_setenv ("GRL_XML_FACTORY_SPECS_PATH", XML_FACTORY_SPECS_PATH, TRUE);
+
+  grl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+#if !GLIB_CHECK_VERSION(2,32,0)
+  g_thread_init (NULL);
+#endif
+
+  test_xml_factory_setup ();
+
+  g_test_add_func ("/xml-factory/cache/remove-owner", test_xml_factory_cache_remove_owner);
+  g_test_add_func ("/xml-factory/cache/usage", test_xml_factory_cache_usage);
+  g_test_add_func ("/xml-factory/cache/evict", test_xml_factory_cache_evict);
+
+  result = g_test_run ();
+
+  test_server_free (server);
+
+  return result;
+}
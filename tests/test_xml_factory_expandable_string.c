@@ -157,6 +157,66 @@ test_xml_factory_expandable_string_percentage (void)
   g_object_unref (options);
 }
 
+static void
+test_xml_factory_expandable_string_invariant (void)
+{
+  GError *error = NULL;
+  GList *m;
+  GList *medias;
+  GrlMedia *media;
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  const gchar *texts[] = { "one", "two" };
+  gchar *album;
+  gchar *id;
+  gchar *title;
+  gint n;
+  guint i;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-expandable-string-invariant");
+  g_assert (source);
+
+  /* Name is expanded without an operation */
+  g_assert_cmpstr (grl_source_get_name (source), ==, "XML Test Invariant");
+
+  options = grl_operation_options_new (NULL);
+
+  /* Values depending only on the parameters are the same for all the items
+     of an operation, but change among operations */
+  for (i = 0; i < G_N_ELEMENTS (texts); i++) {
+    medias = grl_source_search_sync (source,
+                                     texts[i],
+                                     grl_source_supported_keys (source),
+                                     options,
+                                     &error);
+    g_assert_cmpint (g_list_length (medias), ==, 3);
+    g_assert_no_error (error);
+
+    album = g_strconcat ("album-", texts[i], NULL);
+    for (m = medias, n = 1; m; m = g_list_next (m), n++) {
+      media = (GrlMedia *) m->data;
+      g_assert_cmpstr (grl_media_audio_get_album (GRL_MEDIA_AUDIO (media)),
+                       ==,
+                       album);
+
+      /* Values depending on the media are expanded for each item */
+      id = g_strdup_printf ("%d", n);
+      title = g_strdup_printf ("title-%d", n);
+      g_assert_cmpstr (grl_media_get_id (media), ==, id);
+      g_assert_cmpstr (grl_media_get_title (media), ==, title);
+      g_free (id);
+      g_free (title);
+    }
+    g_free (album);
+
+    g_list_free_full (medias, g_object_unref);
+  }
+
+  g_object_unref (options);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -175,6 +235,7 @@ main(int argc, char **argv)
 
   g_test_add_func ("/xml-factory/expandable-string/params", test_xml_factory_expandable_string_params);
   g_test_add_func ("/xml-factory/expandable-string/percentage", test_xml_factory_expandable_string_percentage);
+  g_test_add_func ("/xml-factory/expandable-string/invariant", test_xml_factory_expandable_string_invariant);
 
   return g_test_run ();
 }
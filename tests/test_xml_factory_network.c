@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2013 Igalia S.L.
+ *
+ * Author: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <grilo.h>
+
+#include "test-server.h"
+
+#define XML_FACTORY_ID "grl-xml-factory"
+
+typedef struct {
+  GrlMedia *media;
+  GError *error;
+  gboolean done;
+} SearchData;
+
+static TestServer *server = NULL;
+
+static void
+test_xml_factory_setup (void)
+{
+  GError *error = NULL;
+  GrlConfig *config;
+  GrlRegistry *registry;
+
+  server = test_server_new ();
+
+  /* Sources get the address of the server from the configuration */
+  registry = grl_registry_get_default ();
+  config = grl_config_new (XML_FACTORY_ID, NULL);
+  grl_config_set_string (config, "server", test_server_get_uri (server));
+  grl_registry_add_config (registry, config, &error);
+  g_assert_no_error (error);
+
+  grl_registry_load_all_plugins (registry, &error);
+  g_assert_no_error (error);
+}
+
+static void
+search_cb (GrlSource *source,
+           guint operation_id,
+           GrlMedia *media,
+           guint remaining,
+           gpointer user_data,
+           const GError *error)
+{
+  SearchData *data = (SearchData *) user_data;
+
+  g_assert (!data->done);
+
+  if (media) {
+    g_assert (!data->media);
+    data->media = media;
+  }
+  if (error) {
+    data->error = g_error_copy (error);
+  }
+  data->done = (remaining == 0);
+}
+
+static guint
+search_start_source (const gchar *source_id,
+                     const gchar *text,
+                     SearchData *data)
+{
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  guint operation_id;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, source_id);
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+
+  operation_id = grl_source_search (source,
+                                    text,
+                                    grl_source_supported_keys (source),
+                                    options,
+                                    search_cb,
+                                    data);
+  g_object_unref (options);
+
+  return operation_id;
+}
+
+static guint
+search_start (const gchar *text,
+              SearchData *data)
+{
+  return search_start_source ("xml-test-network-requests", text, data);
+}
+
+static void
+search_wait (SearchData *data)
+{
+  while (!data->done) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+}
+
+static void
+search_assert_title (SearchData *data,
+                     const gchar *title)
+{
+  g_assert_no_error (data->error);
+  g_assert (data->media);
+  g_assert_cmpstr (grl_media_get_title (data->media), ==, title);
+  g_object_unref (data->media);
+}
+
+static void
+search_assert_cancelled (SearchData *data)
+{
+  g_assert (!data->media);
+  g_assert_error (data->error,
+                  GRL_CORE_ERROR,
+                  GRL_CORE_ERROR_OPERATION_CANCELLED);
+  g_error_free (data->error);
+}
+
+static void
+test_xml_factory_network_single_flight (void)
+{
+  SearchData first = { 0 };
+  SearchData second = { 0 };
+
+  test_server_set_content (server, "/single-flight",
+                           "<data><title>Shared</title></data>");
+
+  /* Both operations wait for the same request */
+  test_server_hold (server, "/single-flight");
+  search_start ("single-flight", &first);
+  search_start ("single-flight", &second);
+  test_server_wait_requests (server, "/single-flight", 1);
+  test_server_release (server, "/single-flight");
+
+  search_wait (&first);
+  search_wait (&second);
+  g_assert_cmpuint (test_server_get_requests (server, "/single-flight"), ==, 1);
+  search_assert_title (&first, "Shared");
+  search_assert_title (&second, "Shared");
+}
+
+static void
+test_xml_factory_network_cancel_waiter (void)
+{
+  SearchData first = { 0 };
+  SearchData second = { 0 };
+  guint operation_id;
+
+  test_server_set_content (server, "/cancel-waiter",
+                           "<data><title>Not Cancelled</title></data>");
+
+  test_server_hold (server, "/cancel-waiter");
+  operation_id = search_start ("cancel-waiter", &first);
+  search_start ("cancel-waiter", &second);
+  test_server_wait_requests (server, "/cancel-waiter", 1);
+
+  /* The other waiter keeps the request alive */
+  grl_operation_cancel (operation_id);
+  search_wait (&first);
+  search_assert_cancelled (&first);
+
+  test_server_release (server, "/cancel-waiter");
+  search_wait (&second);
+  g_assert_cmpuint (test_server_get_requests (server, "/cancel-waiter"), ==, 1);
+  search_assert_title (&second, "Not Cancelled");
+}
+
+static void
+test_xml_factory_network_cancel_all (void)
+{
+  SearchData first = { 0 };
+  SearchData second = { 0 };
+  SearchData third = { 0 };
+  guint first_id;
+  guint second_id;
+
+  test_server_set_content (server, "/cancel-all",
+                           "<data><title>Requested Again</title></data>");
+
+  test_server_hold (server, "/cancel-all");
+  first_id = search_start ("cancel-all", &first);
+  second_id = search_start ("cancel-all", &second);
+  test_server_wait_requests (server, "/cancel-all", 1);
+
+  /* Without waiters the request is cancelled */
+  grl_operation_cancel (first_id);
+  grl_operation_cancel (second_id);
+  search_wait (&first);
+  search_wait (&second);
+  search_assert_cancelled (&first);
+  search_assert_cancelled (&second);
+  test_server_release (server, "/cancel-all");
+
+  /* And its response is not cached, so it is requested again */
+  search_start ("cancel-all", &third);
+  search_wait (&third);
+  g_assert_cmpuint (test_server_get_requests (server, "/cancel-all"), ==, 2);
+  search_assert_title (&third, "Requested Again");
+}
+
+static void
+test_xml_factory_network_negative_failure (void)
+{
+  SearchData first = { 0 };
+  SearchData second = { 0 };
+
+  /* The failure is remembered, even if the service recovers meanwhile */
+  search_start ("negative-failure", &first);
+  search_wait (&first);
+  g_assert (!first.media);
+  g_assert_error (first.error, GRL_CORE_ERROR, GRL_CORE_ERROR_SEARCH_FAILED);
+
+  test_server_set_content (server, "/negative-failure",
+                           "<data><title>Recovered</title></data>");
+  search_start ("negative-failure", &second);
+  search_wait (&second);
+  g_assert (!second.media);
+  g_assert_error (second.error, GRL_CORE_ERROR, GRL_CORE_ERROR_SEARCH_FAILED);
+  g_assert_cmpstr (second.error->message, ==, first.error->message);
+  g_assert_cmpuint (test_server_get_requests (server, "/negative-failure"), ==, 1);
+
+  g_error_free (first.error);
+  g_error_free (second.error);
+}
+
+static void
+test_xml_factory_network_negative_empty (void)
+{
+  SearchData first = { 0 };
+  SearchData second = { 0 };
+
+  test_server_set_content (server, "/negative-empty", "");
+
+  search_start ("negative-empty", &first);
+  search_wait (&first);
+  g_assert (!first.media);
+  g_assert (first.error);
+
+  /* The empty response is reused, so the same error is sent */
+  test_server_set_content (server, "/negative-empty",
+                           "<data><title>Not Empty</title></data>");
+  search_start ("negative-empty", &second);
+  search_wait (&second);
+  g_assert (!second.media);
+  g_assert (second.error);
+  g_assert_cmpstr (second.error->message, ==, first.error->message);
+  g_assert_cmpuint (test_server_get_requests (server, "/negative-empty"), ==, 1);
+
+  g_error_free (first.error);
+  g_error_free (second.error);
+}
+
+/* Time to wait for a response cached for one second to expire */
+#define RESPONSE_EXPIRE_USECS (1500 * 1000)
+
+#define REST_ETAG "\"rest-v1\""
+#define REST_LAST_MODIFIED "Sat, 01 Jun 2013 10:00:00 GMT"
+
+static void
+test_xml_factory_network_rest_revalidate (void)
+{
+  SearchData first = { 0 };
+  SearchData second = { 0 };
+
+  test_server_set_content (server, "/rest-revalidate",
+                           "<data><title>Validated</title></data>");
+  test_server_set_validators (server, "/rest-revalidate",
+                              REST_ETAG, REST_LAST_MODIFIED);
+
+  search_start_source ("xml-test-network-rest", "rest-revalidate", &first);
+  search_wait (&first);
+  search_assert_title (&first, "Validated");
+  g_assert (!test_server_get_request_header (server, "/rest-revalidate", "If-None-Match"));
+  g_assert (!test_server_get_request_header (server, "/rest-revalidate", "If-Modified-Since"));
+
+  /* Once expired, the response is only requested again if it has changed.
+     The server says it has not, so the cached content is used */
+  test_server_set_content (server, "/rest-revalidate",
+                           "<data><title>Not Sent</title></data>");
+  g_usleep (RESPONSE_EXPIRE_USECS);
+
+  search_start_source ("xml-test-network-rest", "rest-revalidate", &second);
+  search_wait (&second);
+  g_assert_cmpuint (test_server_get_requests (server, "/rest-revalidate"), ==, 2);
+  g_assert_cmpstr (test_server_get_request_header (server, "/rest-revalidate", "If-None-Match"),
+                   ==,
+                   REST_ETAG);
+  g_assert_cmpstr (test_server_get_request_header (server, "/rest-revalidate", "If-Modified-Since"),
+                   ==,
+                   REST_LAST_MODIFIED);
+  search_assert_title (&second, "Validated");
+}
+
+int
+main(int argc, char **argv)
+{
+  gint result;
+
+  g_setenv ("GRL_PLUGIN_PATH", XML_FACTORY_PLUGIN_PATH, TRUE);
+  g_setenv ("GRL_PLUGIN_LIST", XML_FACTORY_ID, TRUE);
+  g_setenv ("GRL_XML_FACTORY_SPECS_PATH", XML_FACTORY_SPECS_PATH, TRUE);
+
+  grl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+#if !GLIB_CHECK_VERSION(2,32,0)
+  g_thread_init (NULL);
+#endif
+
+  test_xml_factory_setup ();
+
+  g_test_add_func ("/xml-factory/network/single-flight", test_xml_factory_network_single_flight);
+  g_test_add_func ("/xml-factory/network/cancel-waiter", test_xml_factory_network_cancel_waiter);
+  g_test_add_func ("/xml-factory/network/cancel-all", test_xml_factory_network_cancel_all);
+  g_test_add_func ("/xml-factory/network/negative-failure", test_xml_factory_network_negative_failure);
+  g_test_add_func ("/xml-factory/network/negative-empty", test_xml_factory_network_negative_empty);
+  g_test_add_func ("/xml-factory/network/rest-revalidate", test_xml_factory_network_rest_revalidate);
+
+  result = g_test_run ();
+
+  test_server_free (server);
+
+  return result;
+}
@@ -21,9 +21,12 @@
  */
 
 #include <grilo.h>
+#include <json-glib/json-glib.h>
 
 #define XML_FACTORY_ID "grl-xml-factory"
 
+#define ESCAPE_SOURCE_ID "xml-test-private-keys-escape"
+
 static void
 test_xml_factory_setup (void)
 {
@@ -117,6 +120,113 @@ test_xml_factory_private_keys (void)
   g_object_unref (options);
 }
 
+/* Returns the value of the private key @name, decoding the media private
+   keys with json-glib */
+static gchar *
+get_private_key (GrlMedia *media,
+                 const gchar *name)
+{
+  GError *error = NULL;
+  GrlKeyID private_keys_key;
+  GrlRegistry *registry;
+  JsonObject *object;
+  JsonParser *parser;
+  const gchar *json;
+  gchar *value = NULL;
+
+  registry = grl_registry_get_default ();
+  private_keys_key = grl_registry_lookup_metadata_key (registry,
+                                                       "xml-factory-private-keys");
+  json = grl_data_get_string (GRL_DATA (media), private_keys_key);
+  g_assert (json);
+
+  parser = json_parser_new ();
+  json_parser_load_from_data (parser, json, -1, &error);
+  g_assert_no_error (error);
+
+  object = json_node_get_object (json_parser_get_root (parser));
+  if (json_object_has_member (object, name)) {
+    value = g_strdup (json_object_get_string_member (object, name));
+  }
+  g_object_unref (parser);
+
+  return value;
+}
+
+static void
+assert_private_key (GrlMedia *media,
+                    const gchar *name,
+                    const gchar *expected_value)
+{
+  gchar *value;
+
+  value = get_private_key (media, name);
+  g_assert_cmpstr (value, ==, expected_value);
+  g_free (value);
+}
+
+static void
+test_xml_factory_private_keys_escape (void)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlKeyID private_keys_key;
+  GrlMedia *copy;
+  GrlMedia *media;
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, ESCAPE_SOURCE_ID);
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+  private_keys_key = grl_registry_lookup_metadata_key (registry,
+                                                       "xml-factory-private-keys");
+
+  medias = grl_source_browse_sync (source,
+                                   NULL,
+                                   grl_source_supported_keys (source),
+                                   options,
+                                   &error);
+  g_assert_cmpint (g_list_length (medias), ==, 1);
+  g_assert_no_error (error);
+
+  /* Values written by the plugin are read back as they were */
+  media = (GrlMedia *) medias->data;
+  assert_private_key (media, ESCAPE_SOURCE_ID "::quotes", "say \"hi\"");
+  assert_private_key (media, ESCAPE_SOURCE_ID "::backslash", "C:\\dir\\");
+  assert_private_key (media, ESCAPE_SOURCE_ID "::control", "tab\tline\nbell\001end\037");
+  assert_private_key (media, ESCAPE_SOURCE_ID "::unicode", "\303\261and\303\272 \342\202\254 \346\227\245\346\234\254");
+
+  /* A media that only has the private keys as a string, as if it had been
+     deserialized, gets them decoded and merged with the resolved ones */
+  copy = grl_media_audio_new ();
+  grl_media_set_source (copy, ESCAPE_SOURCE_ID);
+  grl_media_set_id (copy, grl_media_get_id (media));
+  grl_data_set_string (GRL_DATA (copy),
+                       private_keys_key,
+                       grl_data_get_string (GRL_DATA (media), private_keys_key));
+
+  grl_source_resolve_sync (source,
+                           copy,
+                           grl_source_supported_keys (source),
+                           options,
+                           &error);
+  g_assert_no_error (error);
+
+  /* New values override the old ones */
+  assert_private_key (copy, ESCAPE_SOURCE_ID "::quotes", "new \"quotes\"");
+  assert_private_key (copy, ESCAPE_SOURCE_ID "::extra", "extra value");
+  assert_private_key (copy, ESCAPE_SOURCE_ID "::backslash", "C:\\dir\\");
+  assert_private_key (copy, ESCAPE_SOURCE_ID "::control", "tab\tline\nbell\001end\037");
+  assert_private_key (copy, ESCAPE_SOURCE_ID "::unicode", "\303\261and\303\272 \342\202\254 \346\227\245\346\234\254");
+
+  g_object_unref (copy);
+  g_list_free_full (medias, g_object_unref);
+  g_object_unref (options);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -134,6 +244,7 @@ main(int argc, char **argv)
   test_xml_factory_setup ();
 
   g_test_add_func ("/xml-factory/private-keys", test_xml_factory_private_keys);
+  g_test_add_func ("/xml-factory/private-keys/escape", test_xml_factory_private_keys_escape);
 
   return g_test_run ();
 }
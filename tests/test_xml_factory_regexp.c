@@ -241,6 +241,16 @@ test_xml_factory_regexp_decode_input (void)
   g_assert_cmpstr (grl_media_audio_get_artist (GRL_MEDIA_AUDIO (media)),
                    ==,
                    "My Artist");
+  /* Numeric references, in decimal and hexadecimal, with leading zeros;
+     invalid ones are kept. Names are case sensitive */
+  g_assert_cmpstr (grl_media_audio_get_album (GRL_MEDIA_AUDIO (media)),
+                   ==,
+                   "Caf\xc3\xa9 AB\xe2\x82\xac &#0; &#xZZ; A &#99999999999; "
+                   "\xc3\x89\xc3\xa9");
+  /* An unterminated '&' does not hide the entities that follow it */
+  g_assert_cmpstr (grl_media_audio_get_genre (GRL_MEDIA_AUDIO (media)),
+                   ==,
+                   "Rock &foo & Roll &unknown;");
 
   g_list_free_full (medias, g_object_unref);
   g_object_unref (options);
@@ -183,6 +183,75 @@ test_xml_factory_requirements_no_match (void)
   g_object_unref (options);
 }
 
+/* Browses the container with @id, returning the title of the result, which
+   tells the operation used */
+static gchar *
+browse_title (GrlSource *source,
+              const gchar *id)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlMedia *container;
+  GrlOperationOptions *options;
+  gchar *title;
+
+  options = grl_operation_options_new (NULL);
+  container = grl_media_box_new ();
+  grl_media_set_id (container, id);
+
+  medias = grl_source_browse_sync (source,
+                                   container,
+                                   grl_source_supported_keys (source),
+                                   options,
+                                   &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_list_length (medias), ==, 1);
+
+  title = g_strdup (grl_media_get_title (GRL_MEDIA (medias->data)));
+
+  g_list_free_full (medias, g_object_unref);
+  g_object_unref (container);
+  g_object_unref (options);
+
+  return title;
+}
+
+static void
+test_xml_factory_requirements_index (void)
+{
+  const gchar *cases[][2] = {
+    /* Exact match */
+    { "root", "Exact root" },
+    /* "$" matches before a trailing newline */
+    { "root\n", "Exact root" },
+    /* Exact match comes before a matching prefix */
+    { "root-artists", "Exact artists" },
+    /* First of the matching prefixes */
+    { "root-albums", "Prefix root" },
+    /* Non-literal expression before the matching prefixes */
+    { "root-12", "Generic number" },
+    /* Non-literal expression after all the literals */
+    { "my-artists", "Generic artists" },
+    /* Operation without requirements */
+    { "rootless", "Fallback" },
+    { NULL, NULL }
+  };
+  GrlRegistry *registry;
+  GrlSource *source;
+  gchar *title;
+  gint i;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-requirements-index");
+  g_assert (source);
+
+  for (i = 0; cases[i][0]; i++) {
+    title = browse_title (source, cases[i][0]);
+    g_assert_cmpstr (title, ==, cases[i][1]);
+    g_free (title);
+  }
+}
+
 int
 main(int argc, char **argv)
 {
@@ -202,6 +271,7 @@ main(int argc, char **argv)
   g_test_add_func ("/xml-factory/requirements/no-check", test_xml_factory_requirements_no_check);
   g_test_add_func ("/xml-factory/requirements/check", test_xml_factory_requirements_check);
   g_test_add_func ("/xml-factory/requirements/no-match", test_xml_factory_requirements_no_match);
+  g_test_add_func ("/xml-factory/requirements/index", test_xml_factory_requirements_index);
 
   return g_test_run ();
 }
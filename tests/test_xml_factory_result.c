@@ -22,17 +22,29 @@
 
 #include <grilo.h>
 
+#include "test-server.h"
+
 #define XML_FACTORY_ID "grl-xml-factory"
 
 static GMainLoop *main_loop = NULL;
+static TestServer *server = NULL;
 
 static void
 test_xml_factory_setup (void)
 {
   GError *error = NULL;
+  GrlConfig *config;
   GrlRegistry *registry;
 
+  server = test_server_new ();
+
+  /* Sources get the address of the server from the configuration */
   registry = grl_registry_get_default ();
+  config = grl_config_new (XML_FACTORY_ID, NULL);
+  grl_config_set_string (config, "server", test_server_get_uri (server));
+  grl_registry_add_config (registry, config, &error);
+  g_assert_no_error (error);
+
   grl_registry_load_all_plugins (registry, &error);
   g_assert_no_error (error);
 
@@ -152,9 +164,409 @@ test_xml_factory_result_cancel (void)
   g_object_unref (options);
 }
 
+typedef struct {
+  GPtrArray *ids;
+  guint remaining;
+  gboolean done;
+} UnorderedData;
+
+static void
+unordered_search_cb (GrlSource *source,
+                     guint operation_id,
+                     GrlMedia *media,
+                     guint remaining,
+                     gpointer user_data,
+                     const GError *error)
+{
+  UnorderedData *data = (UnorderedData *) user_data;
+
+  g_assert_no_error (error);
+  g_assert (!data->done);
+  g_assert (media);
+
+  /* Count goes down one by one, whatever the order of the items */
+  g_assert_cmpuint (remaining, ==, data->remaining - 1);
+  data->remaining = remaining;
+  data->done = (remaining == 0);
+
+  g_ptr_array_add (data->ids, g_strdup (grl_media_get_id (media)));
+  if (g_strcmp0 (grl_media_get_id (media), "number1") == 0) {
+    g_assert_cmpstr (grl_media_audio_get_album (GRL_MEDIA_AUDIO (media)),
+                     ==,
+                     "album1");
+  } else {
+    g_assert (!grl_media_audio_get_album (GRL_MEDIA_AUDIO (media)));
+  }
+  g_object_unref (media);
+
+  /* The other items did not wait for the album of the first one */
+  if (data->ids->len == 2) {
+    test_server_release (server, "/unordered-album");
+  }
+
+  if (data->done) {
+    g_main_loop_quit (main_loop);
+  }
+}
+
+static void
+test_xml_factory_result_unordered (void)
+{
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  UnorderedData data = { 0 };
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-result-unordered");
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+
+  test_server_set_content (server, "/unordered-album", "album1");
+  test_server_hold (server, "/unordered-album");
+
+  data.ids = g_ptr_array_new_with_free_func (g_free);
+  data.remaining = 3;
+  grl_source_search (source,
+                     "test",
+                     grl_source_supported_keys (source),
+                     options,
+                     unordered_search_cb,
+                     &data);
+  g_main_loop_run (main_loop);
+
+  g_assert_cmpuint (data.ids->len, ==, 3);
+  g_assert_cmpstr (g_ptr_array_index (data.ids, 0), ==, "number2");
+  g_assert_cmpstr (g_ptr_array_index (data.ids, 1), ==, "number3");
+  g_assert_cmpstr (g_ptr_array_index (data.ids, 2), ==, "number1");
+  g_assert_cmpuint (test_server_get_requests (server, "/unordered-album"), ==, 1);
+
+  g_ptr_array_free (data.ids, TRUE);
+  g_object_unref (options);
+}
+
+typedef struct {
+  GList *medias;
+  gboolean done;
+} MaxResolvesData;
+
+static void
+max_resolves_search_cb (GrlSource *source,
+                        guint operation_id,
+                        GrlMedia *media,
+                        guint remaining,
+                        gpointer user_data,
+                        const GError *error)
+{
+  MaxResolvesData *data = (MaxResolvesData *) user_data;
+
+  g_assert_no_error (error);
+  g_assert (!data->done);
+
+  if (media) {
+    data->medias = g_list_append (data->medias, media);
+  }
+  data->done = (remaining == 0);
+}
+
+static void
+test_xml_factory_result_max_resolves (void)
+{
+  GList *m;
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  MaxResolvesData data = { 0 };
+  gchar *artist;
+  gchar *content;
+  gchar *id;
+  gchar *path;
+  gchar *title;
+  gint i;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-result-max-resolves");
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+
+  for (i = 1; i <= 6; i++) {
+    path = g_strdup_printf ("/resolve-%d", i);
+    content = g_strdup_printf ("{\"title\": \"title%d\"}", i);
+    test_server_set_content (server, path, content);
+    g_free (content);
+    g_free (path);
+  }
+
+  /* While the first item is being resolved, the rest of the page goes
+     through the remaining slot */
+  test_server_hold (server, "/resolve-1");
+  grl_source_search (source,
+                     "test",
+                     grl_source_supported_keys (source),
+                     options,
+                     max_resolves_search_cb,
+                     &data);
+  test_server_wait_requests (server, "/resolve-6", 1);
+
+  /* But items are not sent before the first one */
+  g_assert (!data.medias);
+  test_server_release (server, "/resolve-1");
+  while (!data.done) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+
+  g_assert_cmpint (g_list_length (data.medias), ==, 6);
+  for (m = data.medias, i = 1; m; m = g_list_next (m), i++) {
+    id = g_strdup_printf ("%d", i);
+    artist = g_strdup_printf ("artist%d", i);
+    title = g_strdup_printf ("title%d", i);
+    g_assert_cmpstr (grl_media_get_id (m->data), ==, id);
+    g_assert_cmpstr (grl_media_audio_get_artist (GRL_MEDIA_AUDIO (m->data)),
+                     ==,
+                     artist);
+    g_assert_cmpstr (grl_media_get_title (m->data), ==, title);
+    g_free (id);
+    g_free (artist);
+    g_free (title);
+  }
+
+  g_list_free_full (data.medias, g_object_unref);
+  g_object_unref (options);
+}
+
+/* Searches @text in the source @source_id, returning the title of the only
+   result */
+static gchar *
+search_title (const gchar *source_id,
+              const gchar *text)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  gchar *title;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, source_id);
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+
+  medias = grl_source_search_sync (source,
+                                   text,
+                                   grl_source_supported_keys (source),
+                                   options,
+                                   &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_list_length (medias), ==, 1);
+
+  title = g_strdup (grl_media_get_title (GRL_MEDIA (medias->data)));
+
+  g_list_free_full (medias, g_object_unref);
+  g_object_unref (options);
+
+  return title;
+}
+
+static void
+test_xml_factory_result_cache (void)
+{
+  gchar *title;
+
+  test_server_set_content (server, "/result-cache-one",
+                           "<data><title>Title One</title></data>");
+  test_server_set_content (server, "/result-cache-two",
+                           "<data><title>Title Two</title></data>");
+
+  /* Each search text has its own result */
+  title = search_title ("xml-test-result-cache", "one");
+  g_assert_cmpstr (title, ==, "Title One");
+  g_free (title);
+
+  title = search_title ("xml-test-result-cache", "two");
+  g_assert_cmpstr (title, ==, "Title Two");
+  g_free (title);
+
+  /* Repeating a search reuses its result, without requesting it again */
+  test_server_set_content (server, "/result-cache-one",
+                           "<data><title>Changed</title></data>");
+  title = search_title ("xml-test-result-cache", "one");
+  g_assert_cmpstr (title, ==, "Title One");
+  g_free (title);
+
+  g_assert_cmpuint (test_server_get_requests (server, "/result-cache-one"), ==, 1);
+  g_assert_cmpuint (test_server_get_requests (server, "/result-cache-two"), ==, 1);
+}
+
+/* Time to wait for a result cached for one second to expire */
+#define RESULT_EXPIRE_USECS (1500 * 1000)
+
+typedef struct {
+  gchar *title;
+  gboolean done;
+} StaleData;
+
+static void
+stale_search_cb (GrlSource *source,
+                 guint operation_id,
+                 GrlMedia *media,
+                 guint remaining,
+                 gpointer user_data,
+                 const GError *error)
+{
+  StaleData *data = (StaleData *) user_data;
+
+  g_assert_no_error (error);
+  g_assert (media);
+  g_assert_cmpuint (remaining, ==, 0);
+
+  data->title = g_strdup (grl_media_get_title (media));
+  data->done = TRUE;
+  g_object_unref (media);
+}
+
+/* Lets the refresh of the result for @text finish, waiting until it
+   replaces the stale one */
+static void
+stale_wait_refresh (const gchar *text,
+                    const gchar *path)
+{
+  gchar *title;
+
+  test_server_release (server, path);
+  title = search_title ("xml-test-result-stale", text);
+  while (g_strcmp0 (title, "Version 2") != 0) {
+    g_assert_cmpstr (title, ==, "Version 1");
+    g_free (title);
+    g_main_context_iteration (NULL, FALSE);
+    title = search_title ("xml-test-result-stale", text);
+  }
+  g_free (title);
+}
+
+static void
+test_xml_factory_result_stale (void)
+{
+  gchar *title;
+
+  test_server_set_content (server, "/result-stale-one",
+                           "<data><title>Version 1</title></data>");
+  title = search_title ("xml-test-result-stale", "one");
+  g_assert_cmpstr (title, ==, "Version 1");
+  g_free (title);
+
+  test_server_set_content (server, "/result-stale-one",
+                           "<data><title>Version 2</title></data>");
+  g_usleep (RESULT_EXPIRE_USECS);
+
+  /* The expired result is sent without waiting for the new one */
+  test_server_hold (server, "/result-stale-one");
+  title = search_title ("xml-test-result-stale", "one");
+  g_assert_cmpstr (title, ==, "Version 1");
+  g_free (title);
+  test_server_wait_requests (server, "/result-stale-one", 2);
+
+  /* Once fetched, the new result replaces it */
+  stale_wait_refresh ("one", "/result-stale-one");
+  g_assert_cmpuint (test_server_get_requests (server, "/result-stale-one"), ==, 2);
+}
+
+static void
+test_xml_factory_result_stale_refresh_once (void)
+{
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  StaleData data1 = { 0 };
+  StaleData data2 = { 0 };
+  gchar *title;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-result-stale");
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+
+  test_server_set_content (server, "/result-stale-two",
+                           "<data><title>Version 1</title></data>");
+  title = search_title ("xml-test-result-stale", "two");
+  g_assert_cmpstr (title, ==, "Version 1");
+  g_free (title);
+
+  test_server_set_content (server, "/result-stale-two",
+                           "<data><title>Version 2</title></data>");
+  g_usleep (RESULT_EXPIRE_USECS);
+
+  /* Both operations get the expired result, but only one refreshes it */
+  test_server_hold (server, "/result-stale-two");
+  grl_source_search (source,
+                     "two",
+                     grl_source_supported_keys (source),
+                     options,
+                     stale_search_cb,
+                     &data1);
+  grl_source_search (source,
+                     "two",
+                     grl_source_supported_keys (source),
+                     options,
+                     stale_search_cb,
+                     &data2);
+  while (!data1.done || !data2.done) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+  g_assert_cmpstr (data1.title, ==, "Version 1");
+  g_assert_cmpstr (data2.title, ==, "Version 1");
+  test_server_wait_requests (server, "/result-stale-two", 2);
+
+  stale_wait_refresh ("two", "/result-stale-two");
+  g_assert_cmpuint (test_server_get_requests (server, "/result-stale-two"), ==, 2);
+
+  g_free (data1.title);
+  g_free (data2.title);
+  g_object_unref (options);
+}
+
+static void
+test_xml_factory_result_negative (void)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  gint i;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-result-negative");
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+
+  test_server_set_content (server, "/result-negative-one", "not xml");
+
+  /* The result that can not be parsed is not requested again */
+  for (i = 0; i < 2; i++) {
+    medias = grl_source_search_sync (source,
+                                     "one",
+                                     grl_source_supported_keys (source),
+                                     options,
+                                     &error);
+    g_assert (!medias);
+    g_assert_error (error, GRL_CORE_ERROR, GRL_CORE_ERROR_SEARCH_FAILED);
+    g_clear_error (&error);
+
+    test_server_set_content (server, "/result-negative-one",
+                             "<data><title>Fixed</title></data>");
+  }
+
+  g_assert_cmpuint (test_server_get_requests (server, "/result-negative-one"), ==, 1);
+
+  g_object_unref (options);
+}
+
 int
 main(int argc, char **argv)
 {
+  gint result;
+
   g_setenv ("GRL_PLUGIN_PATH", XML_FACTORY_PLUGIN_PATH, TRUE);
   g_setenv ("GRL_PLUGIN_LIST", XML_FACTORY_ID, TRUE);
   g_setenv ("GRL_XML_FACTORY_SPECS_PATH", XML_FACTORY_SPECS_PATH, TRUE);
@@ -171,6 +583,16 @@ main(int argc, char **argv)
   g_test_add_func ("/xml-factory/result/empty", test_xml_factory_result_empty);
   g_test_add_func ("/xml-factory/result/skip", test_xml_factory_result_skip);
   g_test_add_func ("/xml-factory/result/cancel", test_xml_factory_result_cancel);
+  g_test_add_func ("/xml-factory/result/unordered", test_xml_factory_result_unordered);
+  g_test_add_func ("/xml-factory/result/max-resolves", test_xml_factory_result_max_resolves);
+  g_test_add_func ("/xml-factory/result/cache", test_xml_factory_result_cache);
+  g_test_add_func ("/xml-factory/result/stale", test_xml_factory_result_stale);
+  g_test_add_func ("/xml-factory/result/stale-refresh-once", test_xml_factory_result_stale_refresh_once);
+  g_test_add_func ("/xml-factory/result/negative", test_xml_factory_result_negative);
+
+  result = g_test_run ();
+
+  test_server_free (server);
 
-  return g_test_run ();
+  return result;
 }
@@ -24,6 +24,10 @@
 
 #define XML_FACTORY_ID "grl-xml-factory"
 
+/* Each big response takes 3 MiB, so the 4 MiB response cache of a source can
+   not hold two of them */
+#define BIG_RESPONSE_PADDING (3 * 1024 * 1024)
+
 static void
 test_xml_factory_setup (void)
 {
@@ -35,6 +39,85 @@ test_xml_factory_setup (void)
   g_assert_no_error (error);
 }
 
+/* Writes the data served by the mocked network for a URL */
+static void
+test_xml_factory_mock_data (const gchar *name,
+                            const gchar *content)
+{
+  GError *error = NULL;
+  gchar *filename;
+
+  filename = g_build_filename (XML_FACTORY_MOCK_PATH, name, NULL);
+  g_file_set_contents (filename, content, -1, &error);
+  g_assert_no_error (error);
+  g_free (filename);
+}
+
+/* Copies the network data to a directory where tests can change it */
+static void
+test_xml_factory_mock_setup (void)
+{
+  const gchar *files[] = { "network-data.ini",
+                           "test-url.data",
+                           "test-url-album.data",
+                           NULL };
+  GError *error = NULL;
+  gchar *content;
+  gchar *filename;
+  gint i;
+
+  g_mkdir_with_parents (XML_FACTORY_MOCK_PATH, 0755);
+  for (i = 0; files[i]; i++) {
+    filename = g_build_filename (XML_FACTORY_DATA_PATH, files[i], NULL);
+    g_file_get_contents (filename, &content, NULL, &error);
+    g_assert_no_error (error);
+    test_xml_factory_mock_data (files[i], content);
+    g_free (content);
+    g_free (filename);
+  }
+}
+
+static void
+test_xml_factory_mock_big_data (const gchar *name,
+                                const gchar *title)
+{
+  gchar *content;
+  gchar *padding;
+
+  padding = g_strnfill (BIG_RESPONSE_PADDING, 'x');
+  content = g_strdup_printf ("<data><title>%s</title><padding>%s</padding></data>",
+                             title, padding);
+  test_xml_factory_mock_data (name, content);
+  g_free (content);
+  g_free (padding);
+}
+
+static gchar *
+test_xml_factory_search_title (GrlSource *source,
+                               const gchar *text)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlOperationOptions *options;
+  gchar *title;
+
+  options = grl_operation_options_new (NULL);
+  medias = grl_source_search_sync (source,
+                                   text,
+                                   grl_source_supported_keys (source),
+                                   options,
+                                   &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_list_length(medias), ==, 1);
+
+  title = g_strdup (grl_media_get_title (GRL_MEDIA (medias->data)));
+
+  g_list_free_full (medias, g_object_unref);
+  g_object_unref (options);
+
+  return title;
+}
+
 static void
 test_xml_factory_url (void)
 {
@@ -76,13 +159,111 @@ test_xml_factory_url (void)
   g_object_unref (options);
 }
 
+static void
+test_xml_factory_url_cache (void)
+{
+  GError *error = NULL;
+  GList *medias;
+  GrlMedia *media;
+  GrlOperationOptions *options;
+  GrlRegistry *registry;
+  GrlSource *source;
+  gint i;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-url-cache");
+  g_assert (source);
+  options = grl_operation_options_new (NULL);
+  g_assert (options);
+
+  test_xml_factory_mock_data ("url-cache.data",
+                              "<data>"
+                              "<artist>My Artist</artist>"
+                              "<title>One Title</title>"
+                              "</data>");
+  test_xml_factory_mock_data ("url-cache-album.data", "My Album\n");
+
+  /* Second time responses, both for the operation and the album key, come
+     from the cache, even if the data has changed in between */
+  for (i = 0; i < 2; i++) {
+    medias = grl_source_browse_sync (source,
+                                     NULL,
+                                     grl_source_supported_keys (source),
+                                     options,
+                                     &error);
+    g_assert_cmpint (g_list_length(medias), ==, 1);
+    g_assert_no_error (error);
+
+    media = (GrlMedia *) medias->data;
+
+    g_assert_cmpstr (grl_media_get_id (media), ==, "id");
+    g_assert_cmpstr (grl_media_audio_get_artist (GRL_MEDIA_AUDIO (media)),
+                     ==,
+                     "My Artist");
+    g_assert_cmpstr (grl_media_audio_get_album (GRL_MEDIA_AUDIO (media)),
+                     ==,
+                     "My Album\n");
+    g_assert_cmpstr (grl_media_get_title (media),
+                     ==,
+                     "One Title");
+
+    g_list_free_full (medias, g_object_unref);
+
+    test_xml_factory_mock_data ("url-cache.data",
+                                "<data>"
+                                "<artist>Other Artist</artist>"
+                                "<title>Other Title</title>"
+                                "</data>");
+    test_xml_factory_mock_data ("url-cache-album.data", "Other Album\n");
+  }
+
+  g_object_unref (options);
+}
+
+static void
+test_xml_factory_url_cache_evict (void)
+{
+  GrlRegistry *registry;
+  GrlSource *source;
+  gchar *title;
+
+  registry = grl_registry_get_default ();
+  source = grl_registry_lookup_source (registry, "xml-test-url-cache-evict");
+  g_assert (source);
+
+  test_xml_factory_mock_big_data ("url-cache-big1.data", "Big One");
+  test_xml_factory_mock_big_data ("url-cache-big2.data", "Big Two");
+
+  title = test_xml_factory_search_title (source, "big1");
+  g_assert_cmpstr (title, ==, "Big One");
+  g_free (title);
+
+  /* While it fits, the response comes from the cache */
+  test_xml_factory_mock_big_data ("url-cache-big1.data", "Big One Changed");
+  title = test_xml_factory_search_title (source, "big1");
+  g_assert_cmpstr (title, ==, "Big One");
+  g_free (title);
+
+  /* Storing the second response exceeds the cache size, so the first one is
+     dropped and requested again */
+  title = test_xml_factory_search_title (source, "big2");
+  g_assert_cmpstr (title, ==, "Big Two");
+  g_free (title);
+
+  title = test_xml_factory_search_title (source, "big1");
+  g_assert_cmpstr (title, ==, "Big One Changed");
+  g_free (title);
+}
+
 int
 main(int argc, char **argv)
 {
   g_setenv ("GRL_PLUGIN_PATH", XML_FACTORY_PLUGIN_PATH, TRUE);
   g_setenv ("GRL_PLUGIN_LIST", XML_FACTORY_ID, TRUE);
   g_setenv ("GRL_XML_FACTORY_SPECS_PATH", XML_FACTORY_SPECS_PATH, TRUE);
-  g_setenv ("GRL_NET_MOCKED", XML_FACTORY_DATA_PATH "network-data.ini", TRUE);
+  g_setenv ("GRL_NET_MOCKED", XML_FACTORY_MOCK_PATH "network-data.ini", TRUE);
+
+  test_xml_factory_mock_setup ();
 
   grl_init (&argc, &argv);
   g_test_init (&argc, &argv, NULL);
@@ -94,6 +275,8 @@ main(int argc, char **argv)
   test_xml_factory_setup ();
 
   g_test_add_func ("/xml-factory/url", test_xml_factory_url);
+  g_test_add_func ("/xml-factory/url/cache", test_xml_factory_url_cache);
+  g_test_add_func ("/xml-factory/url/cache/evict", test_xml_factory_url_cache_evict);
 
   return g_test_run ();
 }